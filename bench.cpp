@@ -0,0 +1,559 @@
+#include <algorithm>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "InitializeLLVM.h"
+#include "CodeCache.h"
+#include "CompilerState.h"
+#include "CompileStats.h"
+#include "Output.h"
+#include "Compile.h"
+#include "Link.h"
+#include "log.h"
+typedef jit::CompilerState State;
+
+// Compile latency benchmark. Builds synthetic blocks of a configurable shape
+// and size and pushes each of them through Output, compile() and link(),
+// reporting exact p50/p99 per phase. The code is never run.
+
+enum class Shape {
+    ALU,
+    Select,
+    Exits,
+    Mixed,
+    Trace,
+    Ops,
+    Vector,
+    Memory,
+};
+
+struct BlockConfig {
+    Shape m_shape;
+    unsigned m_ops;
+    unsigned m_exits;
+};
+
+// Context slots the blocks compute on; the pc lives further up.
+static const unsigned slotCount = 16;
+// Then 16 vector registers of 16 bytes, and the soft TLB.
+static const unsigned vectorCount = 16;
+static const size_t vectorSlot = 40 + 2 * 64;
+static const unsigned tlbEntries = 256;
+static const size_t tlbSlot = vectorSlot + vectorCount * 2;
+static const size_t contextSlots = tlbSlot + tlbEntries * 4;
+
+// Deterministic, so that runs build the very same blocks.
+static inline uint32_t nextRandom(uint32_t& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+static void buildAlu(jit::Output& output, unsigned ops, uint32_t& seed)
+{
+    using namespace jit;
+    LValue values[slotCount] = {};
+    for (unsigned i = 0; i < ops; ++i) {
+        unsigned a = nextRandom(seed) % slotCount;
+        unsigned b = nextRandom(seed) % slotCount;
+        if (!values[a])
+            values[a] = output.buildLoadArgIndex(a);
+        LValue rhs = nextRandom(seed) & 1 ? output.constIntPtr(nextRandom(seed)) : (values[b] ? values[b] : output.buildLoadArgIndex(b));
+        values[a] = output.buildAdd(values[a], rhs);
+    }
+    for (unsigned i = 0; i < slotCount; ++i) {
+        if (values[i])
+            output.buildStoreArgIndex(values[i], i);
+    }
+}
+
+// Every kind of integer op, with partial register writes and lazy flags, the
+// way a guest instruction mix decodes.
+static void buildOps(jit::Output& output, unsigned ops, uint32_t& seed)
+{
+    using namespace jit;
+    LValue values[slotCount] = {};
+    for (unsigned i = 0; i < ops; ++i) {
+        unsigned a = nextRandom(seed) % slotCount;
+        unsigned b = nextRandom(seed) % slotCount;
+        if (!values[a])
+            values[a] = output.buildLoadArgIndex(a);
+        if (!values[b])
+            values[b] = output.buildLoadArgIndex(b);
+        LValue lhs = values[a];
+        LValue rhs = values[b];
+        switch (nextRandom(seed) % 8) {
+        case 0:
+            values[a] = output.buildXor(output.buildAnd(lhs, rhs), output.buildNot(rhs));
+            output.setFlags(FlagsOp::Logic, values[a], lhs, rhs);
+            break;
+        case 1:
+            values[a] = output.buildShl(lhs, rhs);
+            break;
+        case 2:
+            values[a] = output.buildRotateRight(lhs, output.constInt32(nextRandom(seed)));
+            break;
+        case 3: {
+            // adc
+            LValue carry = output.buildFlag(Flag::Carry);
+            values[a] = output.buildAddWithFlags(lhs, rhs, carry).m_value;
+            output.setFlags(FlagsOp::Add, values[a], lhs, rhs, carry);
+            break;
+        }
+        case 4: {
+            // cmp and cmovl
+            output.setFlags(FlagsOp::Sub, output.buildSub(lhs, rhs), lhs, rhs);
+            values[a] = output.buildSelect(output.buildFlagsCondition(LLVMIntSLT), rhs, lhs);
+            break;
+        }
+        case 5:
+            values[a] = output.buildMulHigh(lhs, rhs, nextRandom(seed) & 1 ? Signed : Unsigned);
+            break;
+        case 6:
+            values[a] = output.buildAdd(output.buildPopCount(lhs), output.buildCountLeadingZeros(rhs));
+            break;
+        default:
+            // A write of the second byte, ah and the like.
+            values[a] = output.buildInsertBits(lhs, output.buildTrunc(rhs, 8), 8);
+            break;
+        }
+    }
+    for (unsigned i = 0; i < slotCount; ++i) {
+        if (values[i])
+            output.buildStoreArgIndex(values[i], i);
+    }
+}
+
+// SSE integer and floating point ops on the vector registers.
+static void buildVector(jit::Output& output, unsigned ops, uint32_t& seed)
+{
+    using namespace jit;
+    LType ints = output.vectorType(output.repo().int32, 4);
+    LType floats = output.vectorType(output.repo().floatType, 4);
+    static const int unpack[] = { 0, 4, 1, 5 };
+    for (unsigned i = 0; i < ops; ++i) {
+        unsigned a = nextRandom(seed) % vectorCount;
+        unsigned b = nextRandom(seed) % vectorCount;
+        switch (nextRandom(seed) % 6) {
+        case 0:
+            // paddd
+            output.buildStoreVector(output.buildAdd(output.buildLoadVector(a, ints), output.buildLoadVector(b, ints)), a);
+            break;
+        case 1:
+            // mulps
+            output.buildStoreVector(output.buildFMul(output.buildLoadVector(a, floats), output.buildLoadVector(b, floats)), a);
+            break;
+        case 2:
+            // pcmpgtd
+            output.buildStoreVector(output.buildVectorICmp(LLVMIntSGT, output.buildLoadVector(a, ints), output.buildLoadVector(b, ints)), a);
+            break;
+        case 3:
+            // punpckldq
+            output.buildStoreVector(output.buildShuffle(output.buildLoadVector(a, ints), output.buildLoadVector(b, ints), unpack, 4), a);
+            break;
+        case 4:
+            // psrad
+            output.buildStoreVector(output.buildVectorAShr(output.buildLoadVector(a, ints), nextRandom(seed) % 40), a);
+            break;
+        default:
+            // movd from a general purpose register, zeroing the rest
+            output.buildStoreVector(output.buildInsertLane(constNull(ints), output.buildTrunc(output.buildLoadArgIndex(b % slotCount), 32), 0), a);
+            break;
+        }
+    }
+}
+
+// Guest loads and stores of every width, at addresses computed from the
+// registers.
+static void buildMemory(jit::Output& output, unsigned ops, uint32_t& seed)
+{
+    using namespace jit;
+    LType types[] = { output.repo().int8, output.repo().int16, output.repo().int32, output.repo().int64, output.repo().doubleType };
+    for (unsigned i = 0; i < ops; ++i) {
+        unsigned a = nextRandom(seed) % slotCount;
+        unsigned b = nextRandom(seed) % slotCount;
+        LType type = types[nextRandom(seed) % 5];
+        LValue address = output.buildAdd(output.buildLoadArgIndex(b), output.constIntPtr(nextRandom(seed) & 0xfff));
+        if (nextRandom(seed) & 1) {
+            LValue value = output.buildGuestLoad(address, type);
+            if (type == output.repo().doubleType)
+                value = output.buildBitCast(value, output.repo().int64);
+            output.buildStoreArgIndex(output.buildExtend(value, 64, ZeroExtend), a);
+        } else {
+            LValue value = output.buildLoadArgIndex(a);
+            output.buildGuestStore(type == output.repo().doubleType ? output.buildBitCast(value, type) : output.buildTrunc(value, LLVMGetIntTypeWidth(type)), address);
+        }
+    }
+}
+
+static void buildSelects(jit::Output& output, unsigned ops, uint32_t& seed)
+{
+    using namespace jit;
+    static const LIntPredicate predicates[] = { LLVMIntEQ, LLVMIntNE, LLVMIntSLT, LLVMIntUGT };
+    LValue value = output.buildLoadArgIndex(0);
+    for (unsigned i = 0; i < ops; ++i) {
+        LValue other = output.buildLoadArgIndex(1 + nextRandom(seed) % (slotCount - 1));
+        LValue condition = output.buildICmp(predicates[nextRandom(seed) % 4], value, other);
+        value = output.buildSelect(condition, output.buildAdd(value, output.constIntPtr(1)), other);
+    }
+    output.buildStoreArgIndex(value, 0);
+}
+
+// Each exit hangs off a conditional branch; the last one ends the block.
+static void buildExits(jit::Output& output, unsigned exits, uint32_t& seed)
+{
+    using namespace jit;
+    for (unsigned i = 0; i < exits; ++i) {
+        unsigned kind = nextRandom(seed) % 3;
+        LBasicBlock exit = output.appendBasicBlock("Exit");
+        LBasicBlock next = i + 1 < exits ? output.appendBasicBlock("Next") : nullptr;
+        if (next) {
+            LValue condition = output.buildICmp(LLVMIntEQ, output.buildLoadArgIndex(i % slotCount), output.constIntPtr(i));
+            output.buildCondBr(condition, exit, next);
+        } else {
+            output.buildBr(exit);
+        }
+        output.positionToBBEnd(exit);
+        uintptr_t pc = 0x10000 + (nextRandom(seed) & 0xffff) * 4;
+        switch (kind) {
+        case 0:
+            output.buildDirectPatch(pc);
+            break;
+        case 1:
+            output.buildIndirectPatch(output.buildLoadArgIndex(nextRandom(seed) % slotCount));
+            break;
+        default:
+            output.buildAssistPatch(output.constIntPtr(pc));
+            break;
+        }
+        if (next)
+            output.positionToBBEnd(next);
+    }
+}
+
+// Guest blocks of ALU ops joined by side exits, the way a trace is built.
+static void buildTrace(jit::Output& output, unsigned ops, unsigned exits, uint32_t& seed)
+{
+    using namespace jit;
+    unsigned blocks = exits ? exits : 1;
+    for (unsigned i = 0; i < blocks; ++i) {
+        buildAlu(output, ops / blocks + (i < ops % blocks), seed);
+        if (i + 1 == blocks)
+            break;
+        LValue condition = output.buildICmp(LLVMIntEQ, output.buildLoadArgIndex(nextRandom(seed) % slotCount), output.constIntPtr(i));
+        output.buildSideExit(condition, 0x10000 + (nextRandom(seed) & 0xffff) * 4);
+    }
+    output.buildDirectPatch(0x10000 + (nextRandom(seed) & 0xffff) * 4);
+}
+
+static void buildBlock(State& state, const BlockConfig& config, uint32_t seed)
+{
+    using namespace jit;
+    Output output(state);
+    LBasicBlock body = output.appendBasicBlock("Body");
+    output.buildBr(body);
+    output.positionToBBEnd(body);
+    switch (config.m_shape) {
+    case Shape::Trace:
+        buildTrace(output, config.m_ops, config.m_exits, seed);
+        return;
+    case Shape::ALU:
+        buildAlu(output, config.m_ops, seed);
+        break;
+    case Shape::Select:
+        buildSelects(output, config.m_ops, seed);
+        break;
+    case Shape::Exits:
+        break;
+    case Shape::Ops:
+        buildOps(output, config.m_ops, seed);
+        break;
+    case Shape::Vector:
+        buildVector(output, config.m_ops, seed);
+        break;
+    case Shape::Memory:
+        buildMemory(output, config.m_ops, seed);
+        break;
+    case Shape::Mixed:
+        buildAlu(output, config.m_ops / 2, seed);
+        buildSelects(output, config.m_ops - config.m_ops / 2, seed);
+        break;
+    }
+    buildExits(output, config.m_exits ? config.m_exits : 1, seed);
+}
+
+static void dispatch(void)
+{
+}
+
+// The same byte sequences as the demo patches, so that linking costs what it
+// does for real.
+static uint8_t* emitEpilogue(uint8_t* p)
+{
+    /* 4 bytes: movq %rbp, %rsp; popq %rbp */
+    *p++ = 0x48;
+    *p++ = 0x89;
+    *p++ = 0xec;
+    *p++ = 0x5d;
+    return p;
+}
+
+static uint8_t* emitExit(uint8_t* p, bool call)
+{
+    p = emitEpilogue(p);
+    /* 10 bytes: movabsq $dispatch, %r11 */
+    *p++ = 0x49;
+    *p++ = 0xbb;
+    uintptr_t target = reinterpret_cast<uintptr_t>(dispatch);
+    memcpy(p, &target, sizeof(target));
+    p += sizeof(target);
+    /* 3 bytes: call/jmp *%r11 */
+    *p++ = 0x41;
+    *p++ = 0xff;
+    *p++ = call ? 0xd3 : 0xe3;
+    return p;
+}
+
+static void patchPrologue(void*, uint8_t* start, uint8_t*)
+{
+    /* movq %rbp, %rdi */
+    start[0] = 0x48;
+    start[1] = 0x89;
+    start[2] = 0xef;
+}
+
+static void patchDirect(void*, uint8_t* p)
+{
+    emitExit(p, true);
+}
+
+static void patchIndirect(void*, uint8_t* p)
+{
+    emitExit(p, false);
+}
+
+static void patchAssist(void*, uint8_t* p)
+{
+    emitExit(p, false);
+}
+
+// Blocks never run, so a stub of a ret costs what matters: its allocation.
+static size_t emitAssistStub(void*, uint8_t* buffer, const AssistCallDesc&)
+{
+    /* 1 byte: ret */
+    buffer[0] = 0xc3;
+    return 1;
+}
+
+static void patchAssistCall(void*, uint8_t* p, uint8_t* executable, uint8_t* stub)
+{
+    /* 5 bytes: call rel32 */
+    int32_t delta = static_cast<int32_t>(stub - (executable + 5));
+    *p++ = 0xe8;
+    memcpy(p, &delta, sizeof(delta));
+}
+
+static void patchIndirectJump(void*, uint8_t* p, int reg)
+{
+    uint8_t* end = p + 17;
+    p = emitEpilogue(p);
+    /* jmp *%reg */
+    if (reg >= 8)
+        *p++ = 0x41;
+    *p++ = 0xff;
+    *p++ = 0xe0 | (reg & 7);
+    memset(p, 0x90, end - p);
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [-s alu|select|exits|mixed|trace|ops|vector|memory] [-o ops] [-e exits] [-n compiles] [-w warmup] [-b] [-p passes] [-t] [-r translations] [-m]\n"
+        "  -b  compile at the baseline tier instead of the optimized one\n"
+        "  -p  comma separated passes for the tier, from:",
+        name);
+    for (auto& pass : jit::PassPipeline::passNames())
+        fprintf(stderr, " %s", pass.c_str());
+    fprintf(stderr, "\n"
+                    "  -t  time every pass\n"
+                    "  -r  translations per LLVM context, 0 to never reset it\n"
+                    "  -m  guest memory through a soft TLB rather than direct mapped\n");
+    exit(1);
+}
+
+static double percentile(std::vector<uint64_t>& samples, double fraction)
+{
+    std::sort(samples.begin(), samples.end());
+    size_t rank = static_cast<size_t>(fraction * samples.size());
+    if (rank >= samples.size())
+        rank = samples.size() - 1;
+    return samples[rank] / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+    using namespace jit;
+    BlockConfig config = { Shape::Mixed, 32, 8 };
+    unsigned compiles = 2000;
+    unsigned warmup = 100;
+    Tier tier = Tier::Optimized;
+    PassPipeline pipeline;
+    const char* passes = nullptr;
+    unsigned translationsPerContext = 4096;
+    bool softTLB = false;
+    int option;
+    while ((option = getopt(argc, argv, "s:o:e:n:w:bp:tr:m")) != -1) {
+        switch (option) {
+        case 's':
+            if (!strcmp(optarg, "alu"))
+                config.m_shape = Shape::ALU;
+            else if (!strcmp(optarg, "select"))
+                config.m_shape = Shape::Select;
+            else if (!strcmp(optarg, "exits"))
+                config.m_shape = Shape::Exits;
+            else if (!strcmp(optarg, "mixed"))
+                config.m_shape = Shape::Mixed;
+            else if (!strcmp(optarg, "trace"))
+                config.m_shape = Shape::Trace;
+            else if (!strcmp(optarg, "ops"))
+                config.m_shape = Shape::Ops;
+            else if (!strcmp(optarg, "vector"))
+                config.m_shape = Shape::Vector;
+            else if (!strcmp(optarg, "memory"))
+                config.m_shape = Shape::Memory;
+            else
+                usage(argv[0]);
+            break;
+        case 'o':
+            config.m_ops = atoi(optarg);
+            break;
+        case 'e':
+            config.m_exits = atoi(optarg);
+            break;
+        case 'n':
+            compiles = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 'b':
+            tier = Tier::Baseline;
+            break;
+        case 'p':
+            passes = optarg;
+            break;
+        case 't':
+            pipeline.m_timePasses = true;
+            break;
+        case 'r':
+            translationsPerContext = atoi(optarg);
+            break;
+        case 'm':
+            softTLB = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (!compiles)
+        usage(argv[0]);
+    if (passes)
+        pipeline.m_passes[static_cast<unsigned>(tier)] = passes;
+
+    initLLVM();
+    PlatformDesc desc = {
+        contextSlots * sizeof(intptr_t), /* context size */
+        24 * sizeof(intptr_t), /* offset of pc */
+        3, /* prologue size */
+        17, /* direct size */
+        17, /* indirect size */
+        17, /* assist size */
+        5, /* assist call size */
+        16, /* assist stub size, only for soft TLB misses */
+        40 * sizeof(intptr_t), /* offset of indirect branch cache */
+        64, /* indirect branch cache entries */
+        28 * sizeof(intptr_t), /* offset of pending flags */
+        vectorSlot * sizeof(intptr_t), /* offset of vector registers */
+        vectorCount, /* vector registers */
+        16, /* vector register size */
+        0x100000000, /* guest memory base */
+        tlbSlot * sizeof(intptr_t), /* offset of the soft TLB */
+        softTLB ? tlbEntries : 0, /* soft TLB entries */
+        12, /* soft TLB page shift */
+        { reinterpret_cast<void*>(dispatch), reinterpret_cast<void*>(dispatch), reinterpret_cast<void*>(dispatch),
+            reinterpret_cast<void*>(dispatch), reinterpret_cast<void*>(dispatch), reinterpret_cast<void*>(dispatch) }, /* load misses */
+        { reinterpret_cast<void*>(dispatch), reinterpret_cast<void*>(dispatch), reinterpret_cast<void*>(dispatch),
+            reinterpret_cast<void*>(dispatch), reinterpret_cast<void*>(dispatch), reinterpret_cast<void*>(dispatch) }, /* store misses */
+        0, /* offset of the exit request, nothing is evicted */
+        nullptr, /* opaque */
+        patchPrologue,
+        patchDirect,
+        patchIndirect,
+        patchAssist,
+        nullptr, /* chainDirect */
+        patchIndirectJump,
+        emitAssistStub,
+        patchAssistCall,
+    };
+    CodeCache codeCache(static_cast<size_t>(1) << 30);
+    CompileStats& stats = CompileStats::shared();
+    std::vector<uint64_t> phases[compilePhaseCount];
+    std::vector<uint64_t> totals;
+    uint64_t start = 0;
+    {
+        CompileContext compileContext(pipeline, translationsPerContext);
+        for (unsigned i = 0; i < warmup + compiles; ++i) {
+            if (i == warmup) {
+                stats.reset();
+                start = monotonicNanoseconds();
+            }
+            uint64_t before[compilePhaseCount];
+            for (unsigned phase = 0; phase < compilePhaseCount; ++phase)
+                before[phase] = stats.phase(tier, static_cast<CompilePhase>(phase)).sum();
+            uint64_t begin = monotonicNanoseconds();
+            {
+                State state("bench", desc, codeCache, compileContext.context());
+                state.m_tier = tier;
+                // Blocks differ from one compile to the next but not between
+                // runs.
+                buildBlock(state, config, i);
+                compileContext.session().compile(state);
+                link(state);
+            }
+            compileContext.recycle();
+            if (i < warmup)
+                continue;
+            totals.push_back(monotonicNanoseconds() - begin);
+            for (unsigned phase = 0; phase < compilePhaseCount; ++phase)
+                phases[phase].push_back(stats.phase(tier, static_cast<CompilePhase>(phase)).sum() - before[phase]);
+        }
+    }
+    uint64_t elapsed = monotonicNanoseconds() - start;
+
+    static const char* const shapeNames[] = { "alu", "select", "exits", "mixed", "trace", "ops", "vector", "memory" };
+    printf("%s blocks, %u ops, %u exits, %s tier, %u compiles%s\n", shapeNames[static_cast<unsigned>(config.m_shape)],
+        config.m_ops, config.m_exits, tier == Tier::Optimized ? "optimized" : "baseline", compiles, softTLB ? ", soft TLB" : "");
+    printf("%-16s %10s %10s\n", "phase", "p50 us", "p99 us");
+    for (unsigned phase = 0; phase < compilePhaseCount; ++phase) {
+        if (!stats.phase(tier, static_cast<CompilePhase>(phase)).count())
+            continue;
+        printf("%-16s %10.1f %10.1f\n", CompileStats::phaseName(static_cast<CompilePhase>(phase)),
+            percentile(phases[phase], 0.5), percentile(phases[phase], 0.99));
+    }
+    printf("%-16s %10.1f %10.1f\n", "total", percentile(totals, 0.5), percentile(totals, 0.99));
+    for (auto& name : stats.passNames(tier)) {
+        // Passes that appear more than once count all their runs.
+        const Histogram& histogram = stats.pass(tier, name);
+        printf("  %-22s %8.1f us per compile\n", name.c_str(), histogram.sum() / 1000.0 / compiles);
+    }
+    unsigned guestOps = (config.m_shape == Shape::Exits ? 0 : config.m_ops) + (config.m_exits ? config.m_exits : 1);
+    printf("compiles/s: %.1f\n", compiles / (elapsed / 1e9));
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("peak RSS: %ld KB\n", usage.ru_maxrss);
+    printf("code bytes per guest op: %.1f\n", static_cast<double>(stats.codeBytes(tier).sum()) / (static_cast<double>(compiles) * guestOps));
+    return 0;
+}
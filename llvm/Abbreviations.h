@@ -16,6 +16,7 @@ static inline LType int16Type(LContext context) { return LLVMInt16TypeInContext(
 static inline LType int32Type(LContext context) { return LLVMInt32TypeInContext(context); }
 static inline LType int64Type(LContext context) { return LLVMInt64TypeInContext(context); }
 static inline LType intPtrType(LContext context) { return LLVMInt64TypeInContext(context); }
+static inline LType intType(LContext context, unsigned bits) { return LLVMIntTypeInContext(context, bits); }
 static inline LType floatType(LContext context) { return LLVMFloatTypeInContext(context); }
 static inline LType doubleType(LContext context) { return LLVMDoubleTypeInContext(context); }
 
@@ -126,6 +127,11 @@ static inline LValue getNextFunction(LValue function) { return LLVMGetNextFuncti
 
 static inline void setFunctionCallingConv(LValue function, LCallConv convention) { LLVMSetFunctionCallConv(function, convention); }
 static inline void addTargetDependentFunctionAttr(LValue function, const char* key, const char* value) { LLVMAddTargetDependentFunctionAttr(function, key, value); }
+// |index| counts parameters from 1.
+static inline void addParameterAttr(LContext context, LValue function, unsigned index, const char* name, uint64_t value = 0)
+{
+    LLVMAddAttributeAtIndex(function, index, LLVMCreateEnumAttribute(context, LLVMGetEnumAttributeKindForName(name, std::strlen(name)), value));
+}
 
 static inline LLVMLinkage getLinkage(LValue global) { return LLVMGetLinkage(global); }
 static inline void setLinkage(LValue global, LLVMLinkage linkage) { LLVMSetLinkage(global, linkage); }
@@ -193,6 +199,8 @@ static inline LValue buildSub(LBuilder builder, LValue left, LValue right) { ret
 static inline LValue buildMul(LBuilder builder, LValue left, LValue right) { return LLVMBuildMul(builder, left, right, ""); }
 static inline LValue buildDiv(LBuilder builder, LValue left, LValue right) { return LLVMBuildSDiv(builder, left, right, ""); }
 static inline LValue buildRem(LBuilder builder, LValue left, LValue right) { return LLVMBuildSRem(builder, left, right, ""); }
+static inline LValue buildUDiv(LBuilder builder, LValue left, LValue right) { return LLVMBuildUDiv(builder, left, right, ""); }
+static inline LValue buildURem(LBuilder builder, LValue left, LValue right) { return LLVMBuildURem(builder, left, right, ""); }
 static inline LValue buildNeg(LBuilder builder, LValue value) { return LLVMBuildNeg(builder, value, ""); }
 static inline LValue buildFAdd(LBuilder builder, LValue left, LValue right) { return LLVMBuildFAdd(builder, left, right, ""); }
 static inline LValue buildFSub(LBuilder builder, LValue left, LValue right) { return LLVMBuildFSub(builder, left, right, ""); }
@@ -212,6 +220,7 @@ static inline LValue buildStructGEP(LBuilder builder, LValue pointer, unsigned i
 static inline LValue buildStore(LBuilder builder, LValue value, LValue pointer) { return LLVMBuildStore(builder, value, pointer); }
 static inline LValue buildSExt(LBuilder builder, LValue value, LType type) { return LLVMBuildSExt(builder, value, type, ""); }
 static inline LValue buildZExt(LBuilder builder, LValue value, LType type) { return LLVMBuildZExt(builder, value, type, ""); }
+static inline LValue buildTrunc(LBuilder builder, LValue value, LType type) { return LLVMBuildTrunc(builder, value, type, ""); }
 static inline LValue buildFPToSI(LBuilder builder, LValue value, LType type) { return LLVMBuildFPToSI(builder, value, type, ""); }
 static inline LValue buildFPToUI(LBuilder builder, LValue value, LType type) { return LLVMBuildFPToUI(builder, value, type, ""); }
 static inline LValue buildSIToFP(LBuilder builder, LValue value, LType type) { return LLVMBuildSIToFP(builder, value, type, ""); }
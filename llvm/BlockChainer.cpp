@@ -0,0 +1,123 @@
+#include <assert.h>
+#include "CodeCache.h"
+#include "TranslationCache.h"
+#include "BlockChainer.h"
+
+namespace jit {
+
+BlockChainer::BlockChainer(TranslationCache& translationCache, CodeCache& codeCache, const PlatformDesc& desc)
+    : m_translationCache(translationCache)
+    , m_codeCache(codeCache)
+    , m_desc(desc)
+    , m_hasRetargets(false)
+    , m_chained(0)
+{
+    m_codeCache.setEvictionHandler(evict, this);
+}
+
+BlockChainer::~BlockChainer()
+{
+    m_codeCache.setEvictionHandler(nullptr, nullptr);
+}
+
+void BlockChainer::patch(uint8_t* site, void* entry)
+{
+    m_desc.m_chainDirect(m_desc.m_opaque, m_codeCache.writableAddress(site), site, entry);
+    m_codeCache.flush(site, m_desc.m_directSize);
+}
+
+bool BlockChainer::chain(uint8_t* site, uintptr_t target)
+{
+    assert(m_codeCache.contains(site));
+    std::lock_guard<std::mutex> guard(m_lock);
+    // Looked up under the lock, so that an eviction either comes before and
+    // took the entry away, or after and sees the chain.
+    void* entry = m_translationCache.lookup(target);
+    if (!entry)
+        return false;
+    std::vector<Chain>& incoming = m_incoming[target];
+    for (Chain& chained : incoming) {
+        if (chained.m_site == site)
+            return true;
+    }
+    patch(site, entry);
+    incoming.push_back({ site, entry });
+    m_chained++;
+    return true;
+}
+
+void BlockChainer::unchain(uintptr_t target)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    auto found = m_incoming.find(target);
+    if (found == m_incoming.end())
+        return;
+    for (Chain& chained : found->second)
+        patch(chained.m_site, nullptr);
+    m_incoming.erase(found);
+}
+
+void BlockChainer::invalidate(uintptr_t pc)
+{
+    m_translationCache.remove(pc);
+    unchain(pc);
+}
+
+void BlockChainer::retarget(uintptr_t pc)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_retargets.push_back(pc);
+    m_hasRetargets.store(true, std::memory_order_release);
+}
+
+void BlockChainer::processRetargetsSlow()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    for (uintptr_t pc : m_retargets) {
+        auto found = m_incoming.find(pc);
+        if (found == m_incoming.end())
+            continue;
+        void* entry = m_translationCache.lookup(pc);
+        for (Chain& chained : found->second) {
+            patch(chained.m_site, entry);
+            chained.m_entry = entry;
+        }
+        if (!entry)
+            m_incoming.erase(found);
+    }
+    m_retargets.clear();
+    m_hasRetargets.store(false, std::memory_order_release);
+}
+
+// Runs on the thread allocating code, while the guest thread is kept out
+// of translated code.
+void BlockChainer::evict(void* opaque, uint8_t* begin, uint8_t* end)
+{
+    BlockChainer* chainer = static_cast<BlockChainer*>(opaque);
+    chainer->m_translationCache.removeRange(begin, end);
+    std::lock_guard<std::mutex> guard(chainer->m_lock);
+    auto inRange = [begin, end](const void* address) {
+        return address >= begin && address < end;
+    };
+    // By entry rather than by pc: a site can still be chained to code its
+    // target was promoted away from.
+    for (auto found = chainer->m_incoming.begin(); found != chainer->m_incoming.end();) {
+        std::vector<Chain>& incoming = found->second;
+        size_t kept = 0;
+        for (Chain& chained : incoming) {
+            if (inRange(chained.m_site))
+                continue;
+            if (inRange(chained.m_entry)) {
+                chainer->patch(chained.m_site, nullptr);
+                continue;
+            }
+            incoming[kept++] = chained;
+        }
+        incoming.resize(kept);
+        if (incoming.empty())
+            found = chainer->m_incoming.erase(found);
+        else
+            ++found;
+    }
+}
+}
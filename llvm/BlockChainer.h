@@ -0,0 +1,68 @@
+#ifndef BLOCKCHAINER_H
+#define BLOCKCHAINER_H
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include "PlatformDesc.h"
+
+namespace jit {
+class CodeCache;
+class TranslationCache;
+
+// Links direct exits straight to their target translation, so that a
+// chained exit no longer goes through the dispatcher. Sites are recorded by
+// the executable address of their patch area and are rewritten through the
+// platform's m_chainDirect. Rewriting is not atomic: it must not race with a
+// thread executing the site.
+//
+// The chainer also handles code cache evictions: it drops the translations
+// in the evicted sector and unchains every site jumping into it.
+class BlockChainer {
+public:
+    BlockChainer(TranslationCache& translationCache, CodeCache& codeCache, const PlatformDesc& desc);
+    ~BlockChainer();
+    BlockChainer(const BlockChainer&) = delete;
+    const BlockChainer& operator=(const BlockChainer&) = delete;
+
+    // Chains |site| to the translation of |target| if there is one.
+    bool chain(uint8_t* site, uintptr_t target);
+    // Points every site chained to |target| back at the dispatcher.
+    void unchain(uintptr_t target);
+    // Drops the translation of |pc| and unchains its incoming sites.
+    void invalidate(uintptr_t pc);
+    // Asks for the sites chained to |pc| to be pointed at its current
+    // translation. Can be called from any thread; the patching itself
+    // happens in processRetargets(), on the thread running the guest.
+    void retarget(uintptr_t pc);
+    inline void processRetargets()
+    {
+        if (__builtin_expect(m_hasRetargets.load(std::memory_order_acquire), 0))
+            processRetargetsSlow();
+    }
+
+    inline uint64_t chainedCount() const { return m_chained; }
+    inline CodeCache& codeCache() const { return m_codeCache; }
+
+private:
+    struct Chain {
+        uint8_t* m_site;
+        void* m_entry;
+    };
+
+    void patch(uint8_t* site, void* entry);
+    void processRetargetsSlow();
+    static void evict(void* opaque, uint8_t* begin, uint8_t* end);
+
+    TranslationCache& m_translationCache;
+    CodeCache& m_codeCache;
+    PlatformDesc m_desc;
+    std::unordered_map<uintptr_t, std::vector<Chain>> m_incoming;
+    std::vector<uintptr_t> m_retargets;
+    std::atomic<bool> m_hasRetargets;
+    std::mutex m_lock;
+    uint64_t m_chained;
+};
+}
+#endif /* BLOCKCHAINER_H */
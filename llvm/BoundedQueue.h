@@ -0,0 +1,94 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace jit {
+
+// Lock free multi producer, multi consumer ring of fixed power of two size.
+// Each cell carries a sequence number telling producers and consumers whose
+// turn it is, so neither side ever waits on the other's lock.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : m_cells(new Cell[capacity])
+        , m_mask(capacity - 1)
+        , m_enqueuePos(0)
+        , m_dequeuePos(0)
+    {
+        assert(capacity >= 2 && !(capacity & (capacity - 1)));
+        for (size_t i = 0; i < capacity; ++i)
+            m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+    }
+    BoundedQueue(const BoundedQueue&) = delete;
+    const BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Returns false when the queue is full.
+    bool push(T&& value)
+    {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (!diff) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.m_value = std::move(value);
+                    cell.m_sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false when the queue is empty.
+    bool pop(T& value)
+    {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (!diff) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.m_value);
+                    cell.m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    inline bool empty() const
+    {
+        return m_dequeuePos.load(std::memory_order_acquire) >= m_enqueuePos.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> m_sequence;
+        T m_value;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+    char m_pad0[64];
+    std::atomic<size_t> m_enqueuePos;
+    char m_pad1[64];
+    std::atomic<size_t> m_dequeuePos;
+    char m_pad2[64];
+};
+}
+#endif /* BOUNDEDQUEUE_H */
@@ -0,0 +1,171 @@
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include "log.h"
+#include "CodeCache.h"
+
+namespace jit {
+
+static inline size_t round_up(size_t s, size_t alignment)
+{
+    return (s + alignment - 1) & ~(alignment - 1);
+}
+
+CodeCache::CodeCache(size_t capacity, unsigned sectors)
+    : m_writable(nullptr)
+    , m_executableOffset(0)
+    , m_sectorCount(sectors ? sectors : 1)
+    , m_sectorSize(round_up(capacity / m_sectorCount, sysconf(_SC_PAGESIZE)))
+    , m_top(0)
+    , m_sector(0)
+    , m_sectorUsed(m_sectorCount, 0)
+    , m_sectorPins(m_sectorCount, 0)
+    , m_used(0)
+    , m_evict(nullptr)
+    , m_evictOpaque(nullptr)
+    , m_exitRequest(nullptr)
+    , m_executing(false)
+    , m_evicting(false)
+    , m_evictions(0)
+    , m_evictedBytes(0)
+    , m_seenEvictions(0)
+{
+    m_capacity = m_sectorSize * m_sectorCount;
+    int fd = memfd_create("jit-code-cache", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, m_capacity)) {
+        LOGE("FATAL: Could not create code cache backing: %s", strerror(errno));
+        assert(false);
+    }
+    void* writable = mmap(nullptr, m_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void* executable = mmap(nullptr, m_capacity, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+    close(fd);
+    if (writable == MAP_FAILED || executable == MAP_FAILED) {
+        LOGE("FATAL: Could not map code cache: %s", strerror(errno));
+        assert(false);
+    }
+    m_writable = static_cast<uint8_t*>(writable);
+    m_executableOffset = static_cast<uint8_t*>(executable) - m_writable;
+}
+
+CodeCache::~CodeCache()
+{
+    munmap(executableAddress(m_writable), m_capacity);
+    munmap(m_writable, m_capacity);
+}
+
+uint8_t* CodeCache::allocate(size_t size, unsigned alignment, size_t headroom)
+{
+    if (!alignment)
+        alignment = 1;
+    assert(!(alignment & (alignment - 1)));
+    std::unique_lock<std::mutex> lock(m_lock);
+    // Both views are page aligned, and so are sectors, so an aligned
+    // writable address is an aligned executable address too.
+    size_t start = round_up(m_top + headroom, alignment) - headroom;
+    while (start + size > (m_sector + 1) * m_sectorSize) {
+        if (m_sectorCount == 1 || !m_evict)
+            return nullptr;
+        unsigned next = (m_sector + 1) % m_sectorCount;
+        size_t base = next * m_sectorSize;
+        start = round_up(base + headroom, alignment) - headroom;
+        if (start + size > base + m_sectorSize)
+            return nullptr;
+        // Another thread is evicting it, or code in it is still on its way
+        // to being published.
+        if (m_evicting.load(std::memory_order_relaxed) || m_sectorPins[next]) {
+            m_sectorFree.wait(lock);
+            start = round_up(m_top + headroom, alignment) - headroom;
+            continue;
+        }
+        if (m_sectorUsed[next])
+            evictSector(next, lock);
+        m_sector = next;
+        m_top = base;
+    }
+    size_t end = start + size;
+    m_sectorUsed[m_sector] += end - m_top;
+    m_sectorPins[m_sector]++;
+    m_used.fetch_add(end - m_top, std::memory_order_relaxed);
+    m_top = end;
+    return m_writable + start;
+}
+
+void CodeCache::release(const void* writable)
+{
+    unsigned sector = (static_cast<const uint8_t*>(writable) - m_writable) / m_sectorSize;
+    std::lock_guard<std::mutex> guard(m_lock);
+    assert(m_sectorPins[sector]);
+    if (!--m_sectorPins[sector])
+        m_sectorFree.notify_all();
+}
+
+void CodeCache::setEvictionHandler(EvictFunction evict, void* opaque)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_evict = evict;
+    m_evictOpaque = opaque;
+}
+
+void CodeCache::setExitRequest(uintptr_t* word)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_exitRequest = word;
+}
+
+// Called with m_lock held through |lock|, which is let go of while the guest
+// thread is on its way out.
+void CodeCache::evictSector(unsigned sector, std::unique_lock<std::mutex>& lock)
+{
+    m_evicting.store(true, std::memory_order_seq_cst);
+    // The guest thread leaves translated code at its next dispatch, or at
+    // the next translation entry or loop back-edge when asked to.
+    if (m_exitRequest)
+        __atomic_store_n(m_exitRequest, 1, __ATOMIC_RELAXED);
+    lock.unlock();
+    while (m_executing.load(std::memory_order_seq_cst))
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    lock.lock();
+    uint8_t* writable = m_writable + sector * m_sectorSize;
+    uint8_t* begin = executableAddress(writable);
+    m_evict(m_evictOpaque, begin, begin + m_sectorSize);
+    // Whatever still jumps in traps rather than running newer code.
+    memset(writable, 0xcc, m_sectorUsed[sector]);
+    flush(begin, m_sectorUsed[sector]);
+    m_evictedBytes.fetch_add(m_sectorUsed[sector], std::memory_order_relaxed);
+    m_used.fetch_sub(m_sectorUsed[sector], std::memory_order_relaxed);
+    m_sectorUsed[sector] = 0;
+    LOGD("evicted code cache sector %u.", sector);
+    if (m_exitRequest)
+        __atomic_store_n(m_exitRequest, 0, __ATOMIC_RELAXED);
+    {
+        std::lock_guard<std::mutex> guard(m_evictionLock);
+        m_evictions.fetch_add(1, std::memory_order_release);
+        m_evicting.store(false, std::memory_order_seq_cst);
+    }
+    m_evictionDone.notify_all();
+    m_sectorFree.notify_all();
+}
+
+bool CodeCache::waitForEviction()
+{
+    do {
+        m_executing.store(false, std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(m_evictionLock);
+            m_evictionDone.wait(lock, [this] { return !m_evicting.load(std::memory_order_seq_cst); });
+        }
+        m_executing.store(true, std::memory_order_seq_cst);
+    } while (m_evicting.load(std::memory_order_seq_cst));
+    return true;
+}
+
+void CodeCache::flush(void* executable, size_t size)
+{
+    char* begin = static_cast<char*>(executable);
+    __builtin___clear_cache(begin, begin + size);
+}
+}
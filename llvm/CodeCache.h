@@ -0,0 +1,130 @@
+#ifndef CODECACHE_H
+#define CODECACHE_H
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace jit {
+
+// One contiguous region of translated code, mapped twice: a writable view used
+// by the memory manager and link(), and an executable view the guest runs
+// from. The two views share the same physical pages, so nothing ever has to be
+// mprotect'ed or copied once the code has been emitted.
+//
+// With more than one sector, the capacity is a budget: sectors fill up one
+// after the other, and once the last one is full the oldest is evicted and
+// reused, FIFO. Evicting asks the guest thread out of translated code, see
+// setExitRequest(), waits for it to be out, see beginExecution(), and has the
+// eviction handler forget everything that points into the sector. Code that
+// is allocated but not yet published pins its sector, see release(), and
+// evicting waits for it; a compile must therefore not take more than
+// |sectors| - 1 sectors' worth of allocations, or it would wait for itself.
+class CodeCache {
+public:
+    // Called with the executable range of a sector about to be reused.
+    typedef void (*EvictFunction)(void* opaque, uint8_t* begin, uint8_t* end);
+
+    explicit CodeCache(size_t capacity, unsigned sectors = 1);
+    ~CodeCache();
+    CodeCache(const CodeCache&) = delete;
+    const CodeCache& operator=(const CodeCache&) = delete;
+
+    // Returns the writable address of |size| bytes whose first |headroom| bytes
+    // precede an |alignment| aligned address, or nullptr when the cache is full
+    // and nothing can be evicted. Safe to call from several compiler threads.
+    uint8_t* allocate(size_t size, unsigned alignment, size_t headroom = 0);
+    // Each allocation keeps its sector from being evicted until it is
+    // released, once its code is published or given up on.
+    void release(const void* writable);
+
+    // Without a handler, nothing is ever evicted.
+    void setEvictionHandler(EvictFunction evict, void* opaque);
+    // Evicting sets |*word| to 1 until it is done, or null for none.
+    // Translations poll it, see PlatformDesc::m_exitRequestOffset, so that a
+    // guest looping in chained code or within a region reaches the
+    // dispatcher rather than hold up every allocating thread.
+    void setExitRequest(uintptr_t* word);
+
+    // The guest thread runs translated code, and patches it, only between
+    // beginExecution() and endExecution(). Both return true if a sector was
+    // evicted since the thread last held on to the code, in which case any
+    // code address it kept across the call may be gone.
+    inline bool beginExecution()
+    {
+        m_executing.store(true, std::memory_order_seq_cst);
+        bool evicted = m_evictions.load(std::memory_order_acquire) != m_seenEvictions;
+        if (__builtin_expect(m_evicting.load(std::memory_order_seq_cst), 0))
+            evicted = waitForEviction();
+        m_seenEvictions = m_evictions.load(std::memory_order_acquire);
+        return evicted;
+    }
+    inline void endExecution()
+    {
+        m_executing.store(false, std::memory_order_seq_cst);
+    }
+    // Lets a pending eviction through.
+    inline bool yieldExecution()
+    {
+        if (__builtin_expect(!m_evicting.load(std::memory_order_seq_cst), 1))
+            return false;
+        endExecution();
+        return beginExecution();
+    }
+
+    inline uint8_t* executableAddress(uint8_t* writable) const { return writable + m_executableOffset; }
+    inline uint8_t* writableAddress(void* executable) const { return static_cast<uint8_t*>(executable) - m_executableOffset; }
+    inline bool contains(const void* executable) const
+    {
+        uintptr_t address = reinterpret_cast<uintptr_t>(executable);
+        uintptr_t start = reinterpret_cast<uintptr_t>(m_writable) + m_executableOffset;
+        return address >= start && address < start + m_capacity;
+    }
+
+    // Must be called after bytes reachable from the executable view changed.
+    void flush(void* executable, size_t size);
+
+    inline size_t capacity() const { return m_capacity; }
+    inline unsigned sectorCount() const { return m_sectorCount; }
+    inline size_t sectorSize() const { return m_sectorSize; }
+    // Bytes allocated in the sectors currently holding code.
+    inline size_t used() const { return m_used.load(std::memory_order_relaxed); }
+    inline uint64_t evictions() const { return m_evictions.load(std::memory_order_relaxed); }
+    inline uint64_t evictedBytes() const { return m_evictedBytes.load(std::memory_order_relaxed); }
+
+private:
+    void evictSector(unsigned sector, std::unique_lock<std::mutex>& lock);
+    bool waitForEviction();
+
+    uint8_t* m_writable;
+    ptrdiff_t m_executableOffset;
+    size_t m_capacity;
+    unsigned m_sectorCount;
+    size_t m_sectorSize;
+    // Allocation point, within m_sector.
+    size_t m_top;
+    unsigned m_sector;
+    // Bytes allocated in each sector, and allocations not released yet.
+    std::vector<size_t> m_sectorUsed;
+    std::vector<unsigned> m_sectorPins;
+    std::atomic<size_t> m_used;
+    EvictFunction m_evict;
+    void* m_evictOpaque;
+    uintptr_t* m_exitRequest;
+    std::mutex m_lock;
+    // Signalled when a sector may have become evictable.
+    std::condition_variable m_sectorFree;
+
+    std::atomic<bool> m_executing;
+    std::atomic<bool> m_evicting;
+    std::atomic<uint64_t> m_evictions;
+    std::atomic<uint64_t> m_evictedBytes;
+    // Guest thread only.
+    uint64_t m_seenEvictions;
+    std::mutex m_evictionLock;
+    std::condition_variable m_evictionDone;
+};
+}
+#endif /* CODECACHE_H */
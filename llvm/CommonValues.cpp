@@ -2,6 +2,14 @@
 
 namespace jit {
 
+// A scalar type of its own under |root|, and the tag of accesses to it.
+static LValue tbaaTag(LContext context, LValue root, const char* name)
+{
+    LValue offset = constInt(int64Type(context), 0, ZeroExtend);
+    LValue type = mdNode(context, mdString(context, name), root, offset);
+    return mdNode(context, type, type, offset);
+}
+
 CommonValues::CommonValues(LContext context)
     : voidType(jit::voidType(context))
     , boolean(int1Type(context))
@@ -36,6 +44,15 @@ CommonValues::CommonValues(LContext context)
     , rangeKind(mdKindID(context, "range"))
     , profKind(mdKindID(context, "prof"))
     , branchWeights(mdString(context, "branch_weights"))
+    , tbaaKind(mdKindID(context, "tbaa"))
+    , tbaaRoot(mdNode(context, mdString(context, "jit TBAA")))
+    , tbaaRegisters(tbaaTag(context, tbaaRoot, "registers"))
+    , tbaaVectorRegisters(tbaaTag(context, tbaaRoot, "vector registers"))
+    , tbaaFlags(tbaaTag(context, tbaaRoot, "flags"))
+    , tbaaPC(tbaaTag(context, tbaaRoot, "pc"))
+    , tbaaIndirectCache(tbaaTag(context, tbaaRoot, "indirect branch cache"))
+    , tbaaSoftTLB(tbaaTag(context, tbaaRoot, "soft TLB"))
+    , tbaaGuestMemory(tbaaTag(context, tbaaRoot, "guest memory"))
     , m_context(context)
     , m_module(0)
 {
@@ -50,6 +50,17 @@ public:
     const unsigned rangeKind;
     const unsigned profKind;
     const LValue branchWeights;
+    const unsigned tbaaKind;
+    // TBAA access tags of the memory translations touch, none of which
+    // aliases another: context slots by what they hold, and guest memory.
+    const LValue tbaaRoot;
+    const LValue tbaaRegisters;
+    const LValue tbaaVectorRegisters;
+    const LValue tbaaFlags;
+    const LValue tbaaPC;
+    const LValue tbaaIndirectCache;
+    const LValue tbaaSoftTLB;
+    const LValue tbaaGuestMemory;
 
     LContext const m_context;
     LModule m_module;
@@ -1,6 +1,10 @@
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "log.h"
+#include "CodeCache.h"
+#include "CompileStats.h"
 #include "CompilerState.h"
 #include "Compile.h"
 #define SECTION_NAME_PREFIX "."
@@ -9,49 +13,54 @@
 namespace jit {
 typedef CompilerState State;
 
-static inline size_t round_up(size_t s, unsigned alignment)
-{
-    return (s + alignment - 1) & ~(alignment - 1);
-}
+// MCJIT keeps every object it ever loaded, so an engine is replaced after
+// this many compiles to bound the memory a session holds on to.
+static const unsigned compilesPerEngine = 1024;
 
-static uint8_t* mmAllocateCodeSection(
-    void* opaqueState, uintptr_t size, unsigned alignment, unsigned, const char* sectionName)
+uint8_t* CompilerSession::allocateCodeSection(
+    void* opaque, uintptr_t size, unsigned alignment, unsigned, const char* sectionName)
 {
-    State& state = *static_cast<State*>(opaqueState);
+    State& state = *static_cast<CompilerSession*>(opaque)->m_state;
 
-    state.m_codeSectionList.push_back(jit::ByteBuffer());
-    state.m_codeSectionNames.push_back(sectionName);
-
-    jit::ByteBuffer& bb(state.m_codeSectionList.back());
     size_t additionSize = state.m_platformDesc.m_prologueSize;
     size += additionSize;
-    bb.resize(size);
-    assert((reinterpret_cast<uintptr_t>(bb.data()) & (alignment - 1)) == 0);
+    uint8_t* data = state.m_codeCache.allocate(size, alignment, additionSize);
+    if (!data) {
+        LOGE("FATAL: Code cache exhausted allocating %s.", sectionName);
+        assert(false);
+    }
+    state.m_codeSectionList.push_back({ data, size, alignment });
+    state.m_codeSectionNames.push_back(sectionName);
 
-    return const_cast<uint8_t*>(bb.data() + additionSize);
+    return data + additionSize;
 }
 
-static uint8_t* mmAllocateDataSection(
-    void* opaqueState, uintptr_t size, unsigned alignment, unsigned,
+uint8_t* CompilerSession::allocateDataSection(
+    void* opaque, uintptr_t size, unsigned alignment, unsigned,
     const char* sectionName, LLVMBool)
 {
-    State& state = *static_cast<State*>(opaqueState);
+    State& state = *static_cast<CompilerSession*>(opaque)->m_state;
 
-    state.m_dataSectionList.push_back(jit::ByteBuffer());
     state.m_dataSectionNames.push_back(sectionName);
-
-    jit::ByteBuffer& bb(state.m_dataSectionList.back());
-    bb.resize(size);
-    assert((reinterpret_cast<uintptr_t>(bb.data()) & (alignment - 1)) == 0);
+    // The stack maps are only consumed by link(), so they stay off the cache.
     if (!strcmp(sectionName, SECTION_NAME("llvm_stackmaps"))) {
-        state.m_stackMapsSection = &bb;
+        state.m_stackMapsSection.resize(size);
+        return state.m_stackMapsSection.data();
     }
+    uint8_t* data = state.m_codeCache.allocate(size, alignment);
+    if (!data) {
+        LOGE("FATAL: Code cache exhausted allocating %s.", sectionName);
+        assert(false);
+    }
+    state.m_dataSectionList.push_back({ data, size, alignment });
 
-    return const_cast<uint8_t*>(bb.data());
+    return data;
 }
 
 static LLVMBool mmApplyPermissions(void*, char**)
 {
+    // Nothing to do: code is written through the writable view of the code
+    // cache and runs from the executable one.
     return false;
 }
 
@@ -59,51 +68,208 @@ static void mmDestroy(void*)
 {
 }
 
-void compile(State& state)
+static uint64_t countInstructions(LLVMModuleRef module)
+{
+    uint64_t count = 0;
+    for (LLVMValueRef function = LLVMGetFirstFunction(module); function; function = LLVMGetNextFunction(function)) {
+        for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block; block = LLVMGetNextBasicBlock(block)) {
+            for (LLVMValueRef instruction = LLVMGetFirstInstruction(block); instruction; instruction = LLVMGetNextInstruction(instruction))
+                count++;
+        }
+    }
+    return count;
+}
+
+CompilerSession::CompilerSession(LLVMContextRef context, const PassPipeline& pipeline)
+    : m_context(context)
+    , m_engines()
+    , m_dataLayout(nullptr)
+    , m_timePasses(pipeline.m_timePasses)
+    , m_state(nullptr)
+    , m_serial(0)
 {
+    for (unsigned tier = 0; tier < tierCount; ++tier) {
+        for (unsigned loops = 0; loops < 2; ++loops)
+            buildStages(m_stages[tier][loops], pipeline.passes(static_cast<Tier>(tier), loops));
+    }
+}
+
+CompilerSession::~CompilerSession()
+{
+    for (Engine& engine : m_engines) {
+        if (engine.m_engine)
+            LLVMDisposeExecutionEngine(engine.m_engine);
+    }
+    for (auto& tierStages : m_stages) {
+        for (auto& stages : tierStages) {
+            for (auto& stage : stages)
+                LLVMDisposePassManager(stage.m_passManager);
+        }
+    }
+    free(m_dataLayout);
+}
+
+void CompilerSession::buildStages(StageList& stages, const std::vector<std::string>& passes)
+{
+    // Module pass managers throughout: a function pass manager is tied to
+    // its module.
+    for (auto& pass : passes) {
+        if (stages.empty() || m_timePasses)
+            stages.push_back({ pass, LLVMCreatePassManager() });
+        if (!PassPipeline::addPass(stages.back().m_passManager, pass) && m_timePasses) {
+            LLVMDisposePassManager(stages.back().m_passManager);
+            stages.pop_back();
+        }
+    }
+}
+
+void CompilerSession::runPasses(State& state)
+{
+    StageList& stages = m_stages[static_cast<unsigned>(state.m_tier)][state.m_hasLoops];
+    if (stages.empty())
+        return;
+    PhaseTimer timer(state.m_tier, CompilePhase::Passes);
+    for (auto& stage : stages) {
+        if (!m_timePasses) {
+            LLVMRunPassManager(stage.m_passManager, state.m_module);
+            continue;
+        }
+        uint64_t start = monotonicNanoseconds();
+        LLVMRunPassManager(stage.m_passManager, state.m_module);
+        CompileStats::shared().recordPass(state.m_tier, stage.m_name, monotonicNanoseconds() - start);
+    }
+}
+
+LLVMExecutionEngineRef CompilerSession::engineFor(bool optimize)
+{
+    Engine& engine = m_engines[optimize];
+    if (engine.m_engine && engine.m_compiles < compilesPerEngine)
+        return engine.m_engine;
+    if (engine.m_engine)
+        LLVMDisposeExecutionEngine(engine.m_engine);
+
     LLVMMCJITCompilerOptions options;
     LLVMInitializeMCJITCompilerOptions(&options, sizeof(options));
-    options.OptLevel = 2;
-    LLVMExecutionEngineRef engine;
-    char* error = 0;
+    // The baseline tier only has to be correct, and soon.
+    options.OptLevel = optimize ? 2 : 0;
+    options.EnableFastISel = !optimize;
     options.MCJMM = LLVMCreateSimpleMCJITMemoryManager(
-        &state, mmAllocateCodeSection, mmAllocateDataSection, mmApplyPermissions, mmDestroy);
-    if (LLVMCreateMCJITCompilerForModule(&engine, state.m_module, &options, sizeof(options), &error)) {
+        this, allocateCodeSection, allocateDataSection, mmApplyPermissions, mmDestroy);
+    // The engine wants a module to start with; translations come and go
+    // through LLVMAddModule/LLVMRemoveModule.
+    LLVMModuleRef module = LLVMModuleCreateWithNameInContext("session", m_context);
+    char* error = 0;
+    if (LLVMCreateMCJITCompilerForModule(&engine.m_engine, module, &options, sizeof(options), &error)) {
         LOGE("FATAL: Could not create LLVM execution engine: %s", error);
         assert(false);
     }
+    engine.m_compiles = 0;
+    if (!m_dataLayout)
+        m_dataLayout = LLVMCopyStringRepOfTargetData(LLVMGetExecutionEngineTargetData(engine.m_engine));
+    return engine.m_engine;
+}
+
+void CompilerSession::compile(State& state)
+{
+    bool optimize = state.m_tier == Tier::Optimized;
+    LLVMExecutionEngineRef engine = engineFor(optimize);
     LLVMModuleRef module = state.m_module;
-    LLVMPassManagerRef functionPasses = 0;
-    LLVMPassManagerRef modulePasses;
-    LLVMTargetDataRef targetData = LLVMGetExecutionEngineTargetData(engine);
-    char* stringRepOfTargetData = LLVMCopyStringRepOfTargetData(targetData);
-    LLVMSetDataLayout(module, stringRepOfTargetData);
-    free(stringRepOfTargetData);
-
-    LLVMPassManagerBuilderRef passBuilder = LLVMPassManagerBuilderCreate();
-    LLVMPassManagerBuilderSetOptLevel(passBuilder, 2);
-    LLVMPassManagerBuilderUseInlinerWithThreshold(passBuilder, 275);
-    LLVMPassManagerBuilderSetSizeLevel(passBuilder, 0);
-
-    functionPasses = LLVMCreateFunctionPassManagerForModule(module);
-    modulePasses = LLVMCreatePassManager();
-
-    LLVMPassManagerBuilderPopulateFunctionPassManager(passBuilder, functionPasses);
-    LLVMPassManagerBuilderPopulateModulePassManager(passBuilder, modulePasses);
-
-    LLVMPassManagerBuilderDispose(passBuilder);
-
-    LLVMInitializeFunctionPassManager(functionPasses);
-    for (LLVMValueRef function = LLVMGetFirstFunction(module); function; function = LLVMGetNextFunction(function))
-        LLVMRunFunctionPassManager(functionPasses, function);
-    LLVMFinalizeFunctionPassManager(functionPasses);
-
-    LLVMRunPassManager(modulePasses, module);
-    state.m_entryPoint = reinterpret_cast<void*>(LLVMGetPointerToGlobal(engine, state.m_function));
-
-    if (functionPasses)
-        LLVMDisposePassManager(functionPasses);
-    LLVMDisposePassManager(modulePasses);
-    LLVMDisposeExecutionEngine(engine);
+    LLVMSetDataLayout(module, m_dataLayout);
+    for (LLVMValueRef function : state.m_functions) {
+        // Symbols of every module an engine loaded stay visible to it, so
+        // each translation needs a name of its own.
+        char name[32];
+        int length = snprintf(name, sizeof(name), "translation%llu", static_cast<unsigned long long>(m_serial++));
+        LLVMSetValueName2(function, name, length);
+        // A section per function gets each of them its own prologue headroom.
+        char section[40];
+        snprintf(section, sizeof(section), SECTION_NAME("text.%s"), name);
+        LLVMSetSection(function, section);
+    }
+
+    uint64_t instructions = countInstructions(module);
+    runPasses(state);
+    // Nothing unwinds through translations, and without an unwind table they
+    // get no .eh_frame, which MCJIT would register with the unwinder and
+    // leave registered when the code's sector is evicted. Marked only now:
+    // the passes take a willreturn patchpoint followed by unreachable in a
+    // nounwind function as undefined, and delete the exits.
+    unsigned nounwindKind = LLVMGetEnumAttributeKindForName("nounwind", strlen("nounwind"));
+    for (LLVMValueRef function : state.m_functions)
+        LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex, LLVMCreateEnumAttribute(m_context, nounwindKind, 0));
+
+    m_state = &state;
+    LLVMAddModule(engine, module);
+    {
+        PhaseTimer timer(state.m_tier, CompilePhase::Codegen);
+        for (LLVMValueRef function : state.m_functions) {
+            uint8_t* body = static_cast<uint8_t*>(LLVMGetPointerToGlobal(engine, function));
+            state.m_entryPoints.push_back(state.m_codeCache.executableAddress(body - state.m_platformDesc.m_prologueSize));
+        }
+    }
+    m_state = nullptr;
+    m_engines[optimize].m_compiles++;
+    state.m_entryPoint = state.m_entryPoints.front();
+    uint64_t codeBytes = 0;
+    for (auto& code : state.m_codeSectionList)
+        codeBytes += code.m_size;
+    CompileStats::shared().recordModule(state.m_tier, instructions, codeBytes);
+    LOGP("compiled %lu IR instructions into %lu bytes.", static_cast<unsigned long>(instructions), static_cast<unsigned long>(codeBytes));
+
+    char* error = 0;
+    if (LLVMRemoveModule(engine, module, &module, &error)) {
+        LOGE("FATAL: Could not remove module from LLVM execution engine: %s", error);
+        assert(false);
+    }
+    LLVMDisposeModule(module);
+    state.m_module = nullptr;
+    state.m_function = nullptr;
+    state.m_functions.clear();
+}
+
+CompileContext::CompileContext(const PassPipeline& pipeline, unsigned translationsPerContext)
+    : m_pipeline(pipeline)
+    , m_translationsPerContext(translationsPerContext)
+    , m_translations(0)
+    , m_resets(0)
+    , m_context(nullptr)
+{
+    create();
+}
+
+CompileContext::~CompileContext()
+{
+    destroy();
+}
+
+void CompileContext::create()
+{
+    m_context = LLVMContextCreate();
+    m_session.reset(new CompilerSession(m_context, m_pipeline));
+    m_translations = 0;
+}
+
+void CompileContext::destroy()
+{
+    // The session's engines hold modules of the context.
+    m_session.reset();
+    LLVMContextDispose(m_context);
+    m_context = nullptr;
+}
+
+void CompileContext::recycle()
+{
+    if (!m_translationsPerContext || ++m_translations < m_translationsPerContext)
+        return;
+    destroy();
+    create();
+    m_resets++;
+    LOGD("reset compile context after %u translations.", m_translationsPerContext);
+}
+
+void compile(State& state)
+{
+    CompilerSession session(LLVMGetModuleContext(state.m_module));
+    session.compile(state);
 }
 }
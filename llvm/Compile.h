@@ -1,8 +1,89 @@
 #ifndef COMPILE_H
 #define COMPILE_H
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "LLVMHeaders.h"
+#include "PassPipeline.h"
 
 namespace jit {
 struct CompilerState;
+
+// Long lived compiler for one thread. Keeps an execution engine (and so the
+// target machine) per tier, the data layout string and the populated pass
+// managers, and only moves each translation's module in and out of them.
+// All modules must come from |context|.
+class CompilerSession {
+public:
+    explicit CompilerSession(LLVMContextRef context, const PassPipeline& pipeline = PassPipeline());
+    ~CompilerSession();
+    CompilerSession(const CompilerSession&) = delete;
+    const CompilerSession& operator=(const CompilerSession&) = delete;
+
+    void compile(CompilerState& state);
+
+private:
+    struct Engine {
+        LLVMExecutionEngineRef m_engine;
+        unsigned m_compiles;
+    };
+    // A run of passes in one pass manager, a single pass when timing them.
+    struct Stage {
+        std::string m_name;
+        LLVMPassManagerRef m_passManager;
+    };
+    typedef std::vector<Stage> StageList;
+
+    LLVMExecutionEngineRef engineFor(bool optimize);
+    void buildStages(StageList& stages, const std::vector<std::string>& passes);
+    void runPasses(CompilerState& state);
+    static uint8_t* allocateCodeSection(void* opaque, uintptr_t size, unsigned alignment, unsigned sectionID, const char* sectionName);
+    static uint8_t* allocateDataSection(void* opaque, uintptr_t size, unsigned alignment, unsigned sectionID, const char* sectionName, LLVMBool readOnly);
+
+    LLVMContextRef m_context;
+    Engine m_engines[2];
+    char* m_dataLayout;
+    // Per tier, without and with the loop passes.
+    StageList m_stages[tierCount][2];
+    bool m_timePasses;
+    CompilerState* m_state;
+    uint64_t m_serial;
+};
+
+// A compile thread's LLVM context, reused from one translation to the next
+// together with the session compiling in it: only the modules come and go,
+// while types, constants, metadata and the engines stay. What accumulates
+// in the context is let go by recreating both every |translationsPerContext|
+// translations, 0 meaning never.
+class CompileContext {
+public:
+    explicit CompileContext(const PassPipeline& pipeline = PassPipeline(), unsigned translationsPerContext = 4096);
+    ~CompileContext();
+    CompileContext(const CompileContext&) = delete;
+    const CompileContext& operator=(const CompileContext&) = delete;
+
+    inline LLVMContextRef context() const { return m_context; }
+    inline CompilerSession& session() { return *m_session; }
+    inline uint64_t resets() const { return m_resets; }
+
+    // Counts a translation, and resets the context when it is due. Call it
+    // once no CompilerState built in the context is left.
+    void recycle();
+
+private:
+    void create();
+    void destroy();
+
+    PassPipeline m_pipeline;
+    unsigned m_translationsPerContext;
+    unsigned m_translations;
+    uint64_t m_resets;
+    LLVMContextRef m_context;
+    std::unique_ptr<CompilerSession> m_session;
+};
+
+// One shot compile through a temporary session.
 void compile(CompilerState& state);
 
 }
@@ -0,0 +1,328 @@
+#include <assert.h>
+#include "log.h"
+#include "BlockChainer.h"
+#include "CodeCache.h"
+#include "CompilerState.h"
+#include "Compile.h"
+#include "Link.h"
+#include "PersistentCache.h"
+#include "TranslationCache.h"
+#include "CompileService.h"
+
+namespace jit {
+
+CompileService::CompileService(CodeCache& codeCache, TranslationCache& translationCache, BlockChainer* chainer, unsigned threads, const PassPipeline& pipeline, unsigned translationsPerContext, size_t queueSize)
+    : m_codeCache(codeCache)
+    , m_translationCache(translationCache)
+    , m_chainer(chainer)
+    , m_queue(queueSize)
+    , m_tierUpThreshold(0)
+    , m_persistentCache(nullptr)
+    , m_pipeline(pipeline)
+    , m_translationsPerContext(translationsPerContext)
+    , m_stopping(false)
+    , m_spaceWaiters(0)
+    , m_compiled(0)
+    , m_promoted(0)
+{
+    for (unsigned i = 0; i < threads; ++i)
+        m_threads.emplace_back(&CompileService::run, this);
+}
+
+CompileService::~CompileService()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    m_space.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+std::shared_ptr<CompileService::Ticket> CompileService::submit(const CompileRequest& request, bool wait)
+{
+    std::shared_ptr<Ticket> ticket;
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        if (void* entry = m_translationCache.lookup(request.m_pc)) {
+            ticket = std::make_shared<Ticket>();
+            ticket->m_done = true;
+            ticket->m_entry = entry;
+            return ticket;
+        }
+        auto found = m_pending.find(request.m_pc);
+        if (found != m_pending.end())
+            return found->second;
+        ticket = std::make_shared<Ticket>();
+        Job job = { request, ticket, m_tierUpThreshold ? Tier::Baseline : Tier::Optimized, nullptr, nullptr, 0 };
+        if (!enqueue(std::move(job), wait, lock))
+            return nullptr;
+        m_pending.insert(std::make_pair(request.m_pc, ticket));
+    }
+    m_wakeup.notify_one();
+    return ticket;
+}
+
+bool CompileService::enqueue(Job&& job, bool wait, std::unique_lock<std::mutex>& lock)
+{
+    if (wait) {
+        // Announce the wait before the push that may fail, so that a
+        // worker taking a job afterwards sees it, see run().
+        m_spaceWaiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    bool pushed = false;
+    while (!m_stopping) {
+        if (m_queue.push(std::move(job))) {
+            pushed = true;
+            break;
+        }
+        if (!wait)
+            break;
+        m_space.wait(lock);
+    }
+    if (wait)
+        m_spaceWaiters.fetch_sub(1);
+    return pushed;
+}
+
+void CompileService::prefetch(const CompileRequest& request)
+{
+    if (!m_translationCache.lookup(request.m_pc))
+        submit(request, false);
+}
+
+void* CompileService::translate(const CompileRequest& request)
+{
+    if (void* entry = m_translationCache.lookup(request.m_pc))
+        return entry;
+    // The guest needs this one anyway: when the queue is full, wait for the
+    // workers to make room rather than compile on the guest thread.
+    std::shared_ptr<Ticket> ticket = submit(request, true);
+    if (!ticket)
+        return nullptr;
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_published.wait(lock, [&ticket] { return ticket->m_done; });
+    return ticket->m_entry;
+}
+
+CompileService::Profile* CompileService::profileFor(const CompileRequest& request)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::unique_ptr<Profile>& profile = m_profiles[request.m_pc];
+    if (!profile) {
+        profile.reset(new Profile());
+        profile->m_service = this;
+        profile->m_request = request;
+        profile->m_counter = 0;
+        profile->m_ready = 0;
+        profile->m_desc = { request.m_pc, &profile->m_counter, m_tierUpThreshold, &profile->m_ready, requestTierUp, profile.get() };
+    }
+    return profile.get();
+}
+
+// Called from baseline code on the guest thread: queue the optimized
+// compile and get straight back to running the guest.
+void CompileService::requestTierUp(void* opaque)
+{
+    Profile* profile = static_cast<Profile*>(opaque);
+    CompileService* service = profile->m_service;
+    Job job = { profile->m_request, nullptr, Tier::Optimized, profile, nullptr, 0 };
+    if (!service->m_queue.push(std::move(job))) {
+        // Try again after another round of entries.
+        profile->m_counter = 0;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(service->m_lock);
+    }
+    service->m_wakeup.notify_one();
+}
+
+void CompileService::run()
+{
+    CompileContext compileContext(m_pipeline, m_translationsPerContext);
+    for (;;) {
+        Job job;
+        if (m_queue.pop(job)) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_spaceWaiters.load(std::memory_order_relaxed)) {
+                {
+                    std::lock_guard<std::mutex> guard(m_lock);
+                }
+                m_space.notify_all();
+            }
+            if (m_stopping) {
+                complete(job, nullptr);
+            } else {
+                process(job, compileContext);
+                compileContext.recycle();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_wakeup.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+        if (m_stopping && m_queue.empty())
+            break;
+    }
+}
+
+void CompileService::process(Job& job, CompileContext& compileContext)
+{
+    if (job.m_batch) {
+        processBatch(job, compileContext);
+        return;
+    }
+    const CompileRequest& request = job.m_request;
+    LLVMContextRef context = compileContext.context();
+    // Baseline code is never stored, but an optimized translation from an
+    // earlier run may be, so look for that first.
+    if (m_persistentCache && job.m_tier == Tier::Baseline) {
+        if (void* entry = loadPersistent(request, context)) {
+            finish(job, entry);
+            m_codeCache.release(m_codeCache.writableAddress(entry));
+            return;
+        }
+    }
+    // The state keeps its code pinned in the code cache until it goes away,
+    // which is after publishing.
+    CompilerState state("translation", request.m_desc, m_codeCache, context);
+    state.m_chainer = m_chainer;
+    state.m_tier = job.m_tier;
+    if (job.m_tier == Tier::Baseline) {
+        Profile* profile = profileFor(request);
+        // The optimized translation went away, evicted or flushed, so
+        // start over rather than have the new code exit right away.
+        if (__atomic_load_n(&profile->m_ready, __ATOMIC_ACQUIRE)) {
+            profile->m_counter = 0;
+            __atomic_store_n(&profile->m_ready, 0, __ATOMIC_RELEASE);
+        }
+        state.m_tierUp = &profile->m_desc;
+    }
+    state.m_pc = request.m_pc;
+    void* entry = nullptr;
+    void* loaded = nullptr;
+    if (request.m_build(request.m_opaque, state, request.m_pc)) {
+        bool persist = m_persistentCache && job.m_tier == Tier::Optimized && PersistentCache::portable(state.m_module);
+        uint64_t irHash = persist ? PersistentCache::hashModule(state.m_module) : 0;
+        if (persist)
+            entry = loaded = m_persistentCache->load(request.m_pc, irHash, m_codeCache, m_chainer);
+        if (!entry) {
+            compileContext.session().compile(state);
+            link(state);
+            if (request.m_linked)
+                request.m_linked(request.m_opaque, state);
+            entry = state.m_entryPoint;
+            if (persist)
+                m_persistentCache->record(state, request.m_pc, irHash);
+        }
+    }
+    finish(job, entry);
+    if (loaded)
+        m_codeCache.release(m_codeCache.writableAddress(loaded));
+}
+
+void CompileService::finish(Job& job, void* entry)
+{
+    const CompileRequest& request = job.m_request;
+    if (entry) {
+        publish(request.m_pc, entry);
+        if (job.m_profile) {
+            // Sites chained to the baseline code move over on the guest
+            // thread; the baseline code itself exits once it sees m_ready.
+            if (m_chainer)
+                m_chainer->retarget(request.m_pc);
+            __atomic_store_n(&job.m_profile->m_ready, 1, __ATOMIC_RELEASE);
+            m_promoted.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    complete(job, entry);
+}
+
+void* CompileService::loadPersistent(const CompileRequest& request, LLVMContextRef context)
+{
+    // Only built to be hashed, the way an optimized compile would build it.
+    CompilerState state("translation", request.m_desc, m_codeCache, context);
+    state.m_pc = request.m_pc;
+    if (!request.m_build(request.m_opaque, state, request.m_pc) || !PersistentCache::portable(state.m_module))
+        return nullptr;
+    return m_persistentCache->load(request.m_pc, PersistentCache::hashModule(state.m_module), m_codeCache, m_chainer);
+}
+
+void CompileService::publish(uintptr_t pc, void* entry)
+{
+    if (!m_translationCache.insert(pc, entry)) {
+        LOGD("translation cache full, flushing.");
+        m_translationCache.clear();
+        m_translationCache.insert(pc, entry);
+    }
+    m_compiled.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t CompileService::translateBatch(const CompileRequest* requests, size_t count)
+{
+    if (!count)
+        return 0;
+    std::shared_ptr<Ticket> ticket = std::make_shared<Ticket>();
+    Job job = { requests[0], ticket, Tier::Optimized, nullptr, requests, count };
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (!enqueue(std::move(job), true, lock))
+        return 0;
+    lock.unlock();
+    m_wakeup.notify_one();
+    lock.lock();
+    m_published.wait(lock, [&ticket] { return ticket->m_done; });
+    return ticket->m_published;
+}
+
+void CompileService::processBatch(Job& job, CompileContext& compileContext)
+{
+    const CompileRequest* requests = job.m_batch;
+    size_t count = job.m_batchCount;
+    std::vector<uintptr_t> built;
+    {
+        CompilerState state("batch", requests[0].m_desc, m_codeCache, compileContext.context());
+        state.m_chainer = m_chainer;
+        for (size_t i = 0; i < count; ++i) {
+            const CompileRequest& request = requests[i];
+            if (m_translationCache.lookup(request.m_pc))
+                continue;
+            state.m_pc = request.m_pc;
+            if (request.m_build(request.m_opaque, state, request.m_pc))
+                built.push_back(request.m_pc);
+        }
+        if (!built.empty()) {
+            assert(state.m_functions.size() == built.size());
+            compileContext.session().compile(state);
+            // Exits between blocks of the batch get chained by the
+            // dispatcher once they are taken, as the blocks are only
+            // published after linking.
+            link(state);
+            if (requests[0].m_linked)
+                requests[0].m_linked(requests[0].m_opaque, state);
+            for (size_t i = 0; i < built.size(); ++i)
+                publish(built[i], state.m_entryPoints[i]);
+        }
+    }
+    // Read by translateBatch() once complete() marks the ticket done.
+    job.m_ticket->m_published = built.size();
+    complete(job, nullptr);
+}
+
+void CompileService::complete(Job& job, void* entry)
+{
+    if (!job.m_ticket)
+        return;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        job.m_ticket->m_done = true;
+        job.m_ticket->m_entry = entry;
+        auto found = m_pending.find(job.m_request.m_pc);
+        if (found != m_pending.end() && found->second == job.m_ticket)
+            m_pending.erase(found);
+    }
+    m_published.notify_all();
+}
+}
@@ -0,0 +1,140 @@
+#ifndef COMPILESERVICE_H
+#define COMPILESERVICE_H
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include "CompilerState.h"
+#include "BoundedQueue.h"
+#include "PassPipeline.h"
+
+namespace jit {
+class CodeCache;
+class CompileContext;
+class PersistentCache;
+class TranslationCache;
+class BlockChainer;
+
+// Builds IR for |pc| into |state|. Returns false if there is nothing to
+// translate at |pc|.
+typedef bool (*BuildFunction)(void* opaque, CompilerState& state, uintptr_t pc);
+
+struct CompileRequest {
+    uintptr_t m_pc;
+    BuildFunction m_build;
+    void* m_opaque;
+    PlatformDesc m_desc;
+    // Optional, called on the compiling thread once the code is linked.
+    void (*m_linked)(void* opaque, CompilerState& state);
+};
+
+// Compiles translations on a pool of worker threads, each with its own
+// CompileContext, and publishes the linked code into the translation cache.
+// Requests travel through a lock free queue; a pc is compiled at most once
+// while it is pending.
+//
+// With a tier up threshold, translations are first compiled at the baseline
+// tier and recompiled optimized in the background once they were entered
+// that many times.
+class CompileService {
+public:
+    // The workers compile with |pipeline| from the start, each in an LLVM
+    // context lasting |translationsPerContext| translations, see
+    // CompileContext.
+    CompileService(CodeCache& codeCache, TranslationCache& translationCache, BlockChainer* chainer, unsigned threads, const PassPipeline& pipeline = PassPipeline(), unsigned translationsPerContext = 4096, size_t queueSize = 256);
+    ~CompileService();
+    CompileService(const CompileService&) = delete;
+    const CompileService& operator=(const CompileService&) = delete;
+
+    // Queues |request| unless it is already translated or pending.
+    void prefetch(const CompileRequest& request);
+    // Returns the entry of |request|'s pc, waiting for its compilation, and
+    // for room in the queue, if needed, or nullptr if it could not be
+    // translated.
+    void* translate(const CompileRequest& request);
+    // Has a worker build all |requests| into one module and compile it in a
+    // single codegen run, optimized, and waits for it. Meant for translating
+    // whole regions ahead of time, not for calling from a BuildFunction. The
+    // requests share the first one's PlatformDesc and m_linked. Returns the
+    // number of blocks published.
+    size_t translateBatch(const CompileRequest* requests, size_t count);
+
+    // 0 compiles every translation optimized right away. Set it before
+    // submitting anything.
+    inline void setTierUpThreshold(uint64_t threshold) { m_tierUpThreshold = threshold; }
+    // Optimized translations are then looked up in and recorded to |cache|.
+    // Set it before submitting anything.
+    inline void setPersistentCache(PersistentCache* cache) { m_persistentCache = cache; }
+
+    inline uint64_t compiled() const { return m_compiled.load(std::memory_order_relaxed); }
+    inline uint64_t promoted() const { return m_promoted.load(std::memory_order_relaxed); }
+
+private:
+    struct Ticket {
+        bool m_done = false;
+        void* m_entry = nullptr;
+        // Blocks published by a batch.
+        size_t m_published = 0;
+    };
+    struct Profile {
+        CompileService* m_service;
+        CompileRequest m_request;
+        TierUpDesc m_desc;
+        uint64_t m_counter;
+        uint32_t m_ready;
+    };
+    struct Job {
+        CompileRequest m_request;
+        std::shared_ptr<Ticket> m_ticket;
+        Tier m_tier;
+        Profile* m_profile;
+        // A batch from translateBatch(), of which m_request is the first.
+        const CompileRequest* m_batch;
+        size_t m_batchCount;
+    };
+
+    // Returns nullptr when stopping, or when the queue is full and |wait| is
+    // false.
+    std::shared_ptr<Ticket> submit(const CompileRequest& request, bool wait);
+    // Pushes |job| with m_lock held through |lock|, waiting for room in the
+    // queue when |wait| is true. Returns false when it could not.
+    bool enqueue(Job&& job, bool wait, std::unique_lock<std::mutex>& lock);
+    static void requestTierUp(void* opaque);
+    Profile* profileFor(const CompileRequest& request);
+    void run();
+    void process(Job& job, CompileContext& compileContext);
+    void processBatch(Job& job, CompileContext& compileContext);
+    // Publishes |entry| when there is one, promotes it and completes |job|.
+    void finish(Job& job, void* entry);
+    void complete(Job& job, void* entry);
+    void publish(uintptr_t pc, void* entry);
+    void* loadPersistent(const CompileRequest& request, LLVMContextRef context);
+
+    CodeCache& m_codeCache;
+    TranslationCache& m_translationCache;
+    BlockChainer* m_chainer;
+    BoundedQueue<Job> m_queue;
+    std::vector<std::thread> m_threads;
+    std::unordered_map<uintptr_t, std::shared_ptr<Ticket>> m_pending;
+    std::unordered_map<uintptr_t, std::unique_ptr<Profile>> m_profiles;
+    uint64_t m_tierUpThreshold;
+    PersistentCache* m_persistentCache;
+    const PassPipeline m_pipeline;
+    const unsigned m_translationsPerContext;
+    std::mutex m_lock;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_published;
+    // Signalled as workers take jobs, while m_spaceWaiters threads wait for
+    // room in the queue.
+    std::condition_variable m_space;
+    std::atomic<bool> m_stopping;
+    std::atomic<unsigned> m_spaceWaiters;
+    std::atomic<uint64_t> m_compiled;
+    std::atomic<uint64_t> m_promoted;
+};
+}
+#endif /* COMPILESERVICE_H */
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <time.h>
+#include "CompileStats.h"
+
+namespace jit {
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+void Histogram::add(uint64_t value)
+{
+    unsigned i = value ? 64 - __builtin_clzll(value) : 0;
+    if (i >= bucketCount)
+        i = bucketCount - 1;
+    m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::reset()
+{
+    for (auto& bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::quantile(double fraction) const
+{
+    uint64_t total = count();
+    if (!total)
+        return 0;
+    uint64_t rank = static_cast<uint64_t>(fraction * total);
+    if (rank >= total)
+        rank = total - 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < bucketCount; ++i) {
+        seen += bucket(i);
+        if (seen > rank) {
+            uint64_t bound = i ? (static_cast<uint64_t>(1) << i) - 1 : 0;
+            return bound < max() ? bound : max();
+        }
+    }
+    return max();
+}
+
+CompileStats& CompileStats::shared()
+{
+    static CompileStats stats;
+    return stats;
+}
+
+const char* CompileStats::phaseName(CompilePhase phase)
+{
+    switch (phase) {
+    case CompilePhase::BuildIR:
+        return "build IR";
+    case CompilePhase::Passes:
+        return "passes";
+    case CompilePhase::Codegen:
+        return "codegen";
+    case CompilePhase::StackMapParse:
+        return "stackmap parse";
+    case CompilePhase::Link:
+        return "link";
+    }
+    __builtin_unreachable();
+}
+
+void CompileStats::recordModule(Tier tier, uint64_t instructions, uint64_t codeBytes)
+{
+    m_instructions[index(tier)].add(instructions);
+    m_codeBytes[index(tier)].add(codeBytes);
+}
+
+void CompileStats::recordPass(Tier tier, const std::string& name, uint64_t nanoseconds)
+{
+    Histogram* histogram;
+    {
+        std::lock_guard<std::mutex> guard(m_passLock);
+        histogram = &m_passes[index(tier)][name];
+    }
+    histogram->add(nanoseconds);
+}
+
+std::vector<std::string> CompileStats::passNames(Tier tier) const
+{
+    std::lock_guard<std::mutex> guard(m_passLock);
+    std::vector<std::string> names;
+    for (auto& entry : m_passes[index(tier)])
+        names.push_back(entry.first);
+    return names;
+}
+
+const Histogram& CompileStats::pass(Tier tier, const std::string& name) const
+{
+    std::lock_guard<std::mutex> guard(m_passLock);
+    return m_passes[index(tier)][name];
+}
+
+static const char* const tierNames[tierCount] = { "baseline", "optimized" };
+
+void CompileStats::dump(FILE* file) const
+{
+    for (unsigned tier = 0; tier < tierCount; ++tier) {
+        const Histogram& modules = m_codeBytes[tier];
+        if (!modules.count())
+            continue;
+        fprintf(file, "%s: %lu modules, %lu IR instructions, %lu code bytes.\n", tierNames[tier],
+            static_cast<unsigned long>(modules.count()),
+            static_cast<unsigned long>(m_instructions[tier].sum()),
+            static_cast<unsigned long>(modules.sum()));
+        for (unsigned phase = 0; phase < compilePhaseCount; ++phase) {
+            const Histogram& histogram = m_phases[tier][phase];
+            if (!histogram.count())
+                continue;
+            fprintf(file, "  %-16s total %lu us, p50 %lu us, p99 %lu us, max %lu us.\n",
+                phaseName(static_cast<CompilePhase>(phase)),
+                static_cast<unsigned long>(histogram.sum() / 1000),
+                static_cast<unsigned long>(histogram.quantile(0.5) / 1000),
+                static_cast<unsigned long>(histogram.quantile(0.99) / 1000),
+                static_cast<unsigned long>(histogram.max() / 1000));
+        }
+        for (auto& name : passNames(static_cast<Tier>(tier))) {
+            const Histogram& histogram = pass(static_cast<Tier>(tier), name);
+            if (!histogram.count())
+                continue;
+            fprintf(file, "    %-22s total %lu us, p50 %lu us.\n", name.c_str(),
+                static_cast<unsigned long>(histogram.sum() / 1000),
+                static_cast<unsigned long>(histogram.quantile(0.5) / 1000));
+        }
+    }
+}
+
+void CompileStats::dumpAtExit()
+{
+    static std::atomic<bool> registered(false);
+    if (!registered.exchange(true))
+        atexit([] { CompileStats::shared().dump(); });
+}
+
+void CompileStats::reset()
+{
+    for (unsigned tier = 0; tier < tierCount; ++tier) {
+        for (auto& histogram : m_phases[tier])
+            histogram.reset();
+        m_instructions[tier].reset();
+        m_codeBytes[tier].reset();
+        std::lock_guard<std::mutex> guard(m_passLock);
+        for (auto& entry : m_passes[tier])
+            entry.second.reset();
+    }
+}
+
+uint64_t monotonicNanoseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+}
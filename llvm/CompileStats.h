@@ -0,0 +1,115 @@
+#ifndef COMPILESTATS_H
+#define COMPILESTATS_H
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "CompilerState.h"
+
+namespace jit {
+
+enum class CompilePhase {
+    BuildIR,
+    Passes,
+    Codegen,
+    StackMapParse,
+    Link,
+};
+static const unsigned compilePhaseCount = static_cast<unsigned>(CompilePhase::Link) + 1;
+static const unsigned tierCount = static_cast<unsigned>(Tier::Optimized) + 1;
+
+// Power of two buckets: bucket i counts the values in [2^(i-1), 2^i).
+// Updated with relaxed atomics, so readers racing with compiler threads see a
+// slightly stale but usable picture.
+class Histogram {
+public:
+    static const unsigned bucketCount = 64;
+
+    Histogram();
+    Histogram(const Histogram&) = delete;
+    const Histogram& operator=(const Histogram&) = delete;
+
+    void add(uint64_t value);
+    void reset();
+
+    inline uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    inline uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+    inline uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+    inline uint64_t bucket(unsigned i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding the |fraction| quantile, 0 if empty.
+    uint64_t quantile(double fraction) const;
+
+private:
+    std::atomic<uint64_t> m_buckets[bucketCount];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
+
+// Where compile time goes, per tier: latency of each phase in nanoseconds,
+// and the size of what was compiled.
+class CompileStats {
+public:
+    static CompileStats& shared();
+    static const char* phaseName(CompilePhase phase);
+
+    inline const Histogram& phase(Tier tier, CompilePhase phase) const { return m_phases[index(tier)][static_cast<unsigned>(phase)]; }
+    // IR instructions handed to the optimizer, one sample per module.
+    inline const Histogram& instructions(Tier tier) const { return m_instructions[index(tier)]; }
+    // Bytes of code emitted, one sample per module.
+    inline const Histogram& codeBytes(Tier tier) const { return m_codeBytes[index(tier)]; }
+
+    inline void record(Tier tier, CompilePhase phase, uint64_t nanoseconds) { m_phases[index(tier)][static_cast<unsigned>(phase)].add(nanoseconds); }
+    void recordModule(Tier tier, uint64_t instructions, uint64_t codeBytes);
+    // Time of single passes, only recorded with PassPipeline::m_timePasses.
+    void recordPass(Tier tier, const std::string& name, uint64_t nanoseconds);
+    std::vector<std::string> passNames(Tier tier) const;
+    const Histogram& pass(Tier tier, const std::string& name) const;
+
+    // Whatever the log level.
+    void dump(FILE* file = stderr) const;
+    // To stderr.
+    void dumpAtExit();
+    void reset();
+
+private:
+    CompileStats() = default;
+    static inline unsigned index(Tier tier) { return static_cast<unsigned>(tier); }
+
+    Histogram m_phases[tierCount][compilePhaseCount];
+    Histogram m_instructions[tierCount];
+    Histogram m_codeBytes[tierCount];
+    // Histograms are never removed, so references to them stay valid.
+    mutable std::mutex m_passLock;
+    mutable std::map<std::string, Histogram> m_passes[tierCount];
+};
+
+uint64_t monotonicNanoseconds();
+
+// Adds the time between construction and destruction to a phase.
+class PhaseTimer {
+public:
+    PhaseTimer(Tier tier, CompilePhase phase)
+        : m_tier(tier)
+        , m_phase(phase)
+        , m_start(monotonicNanoseconds())
+    {
+    }
+    ~PhaseTimer()
+    {
+        CompileStats::shared().record(m_tier, m_phase, monotonicNanoseconds() - m_start);
+    }
+    PhaseTimer(const PhaseTimer&) = delete;
+    const PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    Tier m_tier;
+    CompilePhase m_phase;
+    uint64_t m_start;
+};
+}
+#endif /* COMPILESTATS_H */
@@ -1,21 +1,44 @@
+#include "CodeCache.h"
 #include "CompilerState.h"
 
 namespace jit {
 
-CompilerState::CompilerState(const char* moduleName, const PlatformDesc& desc)
-    : m_stackMapsSection(nullptr)
-    , m_module(nullptr)
+CompilerState::CompilerState(const char* moduleName, const PlatformDesc& desc, CodeCache& codeCache)
+    : CompilerState(moduleName, desc, codeCache, LLVMContextCreate())
+{
+    m_ownsContext = true;
+}
+
+CompilerState::CompilerState(const char* moduleName, const PlatformDesc& desc, CodeCache& codeCache, LLVMContextRef context)
+    : m_module(nullptr)
     , m_function(nullptr)
-    , m_context(nullptr)
+    , m_context(context)
+    , m_ownsContext(false)
     , m_entryPoint(nullptr)
+    , m_codeCache(codeCache)
+    , m_chainer(nullptr)
+    , m_tier(Tier::Optimized)
+    , m_tierUp(nullptr)
+    , m_pc(0)
+    , m_hasLoops(false)
     , m_platformDesc(desc)
 {
-    m_context = LLVMContextCreate();
-    m_module = LLVMModuleCreateWithNameInContext("test", m_context);
+    m_module = LLVMModuleCreateWithNameInContext(moduleName, m_context);
 }
 
 CompilerState::~CompilerState()
 {
-    LLVMContextDispose(m_context);
+    // Published or given up on by now, so the sections may be evicted.
+    for (auto& section : m_codeSectionList)
+        m_codeCache.release(section.m_data);
+    for (auto& section : m_dataSectionList)
+        m_codeCache.release(section.m_data);
+    if (m_ownsContext) {
+        LLVMContextDispose(m_context);
+        return;
+    }
+    // compile() hands the module to the execution engine, which frees it.
+    if (m_module)
+        LLVMDisposeModule(m_module);
 }
 }
@@ -8,34 +8,96 @@
 #include "LLVMHeaders.h"
 #include "PlatformDesc.h"
 namespace jit {
+class CodeCache;
+class BlockChainer;
+
 enum class PatchType {
     Direct,
     Indirect,
+    IndirectJump,
     Assist,
+    AssistCall,
 };
 
 struct PatchDesc {
     PatchType m_type;
+    uintptr_t m_target; // guest pc of a direct exit, helper of an AssistCall
+};
+
+enum class Tier {
+    Baseline,
+    Optimized,
+};
+
+// Baseline code counts its entries. When the count reaches m_threshold it
+// calls m_request(m_opaque) to have an optimized version built, and once
+// *m_ready is set it exits to the dispatcher so that the optimized code takes
+// over.
+struct TierUpDesc {
+    uintptr_t m_pc;
+    uint64_t* m_counter;
+    uint64_t m_threshold;
+    const uint32_t* m_ready;
+    void (*m_request)(void* opaque);
+    void* m_opaque;
 };
 
 typedef std::vector<uint8_t> ByteBuffer;
 typedef std::list<ByteBuffer> BufferList;
+
+// A section living in the code cache, addressed through its writable view.
+struct CodeSection {
+    uint8_t* m_data;
+    size_t m_size;
+    unsigned m_alignment;
+};
+typedef std::list<CodeSection> SectionList;
 typedef std::list<std::string> StringList;
 typedef std::unordered_map<unsigned /* stackmaps id */, PatchDesc> PatchMap;
 
+// A linked patch site, m_offset bytes into the body of m_functions[m_function].
+struct PatchSite {
+    unsigned m_function;
+    uint32_t m_offset;
+    int m_reg; // holds the jump target of an IndirectJump
+    PatchDesc m_desc;
+    AssistCallDesc m_assist; // of an AssistCall, filled from its stack map
+};
+typedef std::vector<PatchSite> PatchSiteList;
+
 struct CompilerState {
-    BufferList m_codeSectionList;
-    BufferList m_dataSectionList;
+    SectionList m_codeSectionList;
+    SectionList m_dataSectionList;
+    ByteBuffer m_stackMapsSection;
     StringList m_codeSectionNames;
     StringList m_dataSectionNames;
-    ByteBuffer* m_stackMapsSection;
     PatchMap m_patchMap;
+    // Filled by link(), ordered by function.
+    PatchSiteList m_patchSites;
     LLVMModuleRef m_module;
+    // The function being built. A module may hold several block functions,
+    // kept in m_functions in build order; compile() fills m_entryPoints in the
+    // same order and m_entryPoint with the first of them.
     LLVMValueRef m_function;
+    std::vector<LLVMValueRef> m_functions;
     LLVMContextRef m_context;
+    bool m_ownsContext;
     void* m_entryPoint;
+    std::vector<void*> m_entryPoints;
+    CodeCache& m_codeCache;
+    BlockChainer* m_chainer;
+    Tier m_tier;
+    const TierUpDesc* m_tierUp;
+    // Guest pc of the function being built, where it leaves for when asked
+    // to, see PlatformDesc::m_exitRequestOffset.
+    uintptr_t m_pc;
+    // Some function of the module loops within itself, see
+    // Output::buildRegionBranch().
+    bool m_hasLoops;
     struct PlatformDesc m_platformDesc;
-    CompilerState(const char* moduleName, const PlatformDesc& desc);
+    CompilerState(const char* moduleName, const PlatformDesc& desc, CodeCache& codeCache);
+    // Builds into a context owned by the caller, typically one per thread.
+    CompilerState(const char* moduleName, const PlatformDesc& desc, CodeCache& codeCache, LLVMContextRef context);
     ~CompilerState();
     CompilerState(const CompilerState&) = delete;
     const CompilerState& operator=(const CompilerState&) = delete;
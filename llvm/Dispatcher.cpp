@@ -0,0 +1,90 @@
+#include <assert.h>
+#include <stdint.h>
+#include "log.h"
+#include "CodeCache.h"
+#include "IndirectBranchCache.h"
+#include "SoftTLB.h"
+#include "TranslationCache.h"
+#include "BlockChainer.h"
+#include "Dispatcher.h"
+
+namespace jit {
+
+Dispatcher::Dispatcher(TranslationCache& cache, const PlatformDesc& desc, EnterFunction enter, TranslateFunction translate, void* opaque, BlockChainer* chainer)
+    : m_cache(cache)
+    , m_chainer(chainer)
+    , m_desc(desc)
+    , m_enter(enter)
+    , m_translate(translate)
+    , m_opaque(opaque)
+    , m_dispatches(0)
+    , m_translations(0)
+{
+    assert(validIndirectBranchCacheEntries(desc.m_indirectCacheEntries));
+}
+
+void Dispatcher::run(void* context)
+{
+    uint8_t* site = nullptr;
+    uint64_t generation = m_cache.generation();
+    if (m_desc.m_indirectCacheEntries)
+        clearIndirectBranchCache(context, m_desc);
+    if (m_desc.m_tlbEntries)
+        flushSoftTLB(context, m_desc);
+    // Code cache sectors are only evicted while this thread is out of
+    // translated code: while it translates, or when it yields below.
+    CodeCache* codeCache = m_chainer ? &m_chainer->codeCache() : nullptr;
+    uintptr_t* exitRequest = nullptr;
+    if (codeCache && m_desc.m_exitRequestOffset) {
+        exitRequest = reinterpret_cast<uintptr_t*>(static_cast<uint8_t*>(context) + m_desc.m_exitRequestOffset);
+        *exitRequest = 0;
+        codeCache->setExitRequest(exitRequest);
+    }
+    if (codeCache)
+        codeCache->beginExecution();
+    for (;;) {
+        if (codeCache && codeCache->yieldExecution())
+            site = nullptr;
+        uintptr_t pc = guestPC(context);
+        void* entry = m_cache.lookup(pc);
+        if (__builtin_expect(!entry, 0)) {
+            if (codeCache)
+                codeCache->endExecution();
+            entry = m_translate(m_opaque, pc);
+            if (!entry) {
+                if (exitRequest)
+                    codeCache->setExitRequest(nullptr);
+                return;
+            }
+            if (codeCache && codeCache->beginExecution()) {
+                // |entry| may be gone already.
+                site = nullptr;
+                continue;
+            }
+            m_translations++;
+            if (!m_cache.insert(pc, entry)) {
+                LOGD("translation cache full, flushing.");
+                m_cache.clear();
+                m_cache.insert(pc, entry);
+            }
+        }
+        // The direct exit we came from can now skip the dispatcher, and
+        // indirect exits to |pc| can find it inline.
+        if (m_chainer) {
+            m_chainer->processRetargets();
+            if (site)
+                m_chainer->chain(site - m_desc.m_directSize, pc);
+        }
+        if (m_desc.m_indirectCacheEntries) {
+            uint64_t current = m_cache.generation();
+            if (__builtin_expect(current != generation, 0)) {
+                clearIndirectBranchCache(context, m_desc);
+                generation = current;
+            }
+            fillIndirectBranchCache(context, m_desc, pc, entry);
+        }
+        m_dispatches++;
+        site = static_cast<uint8_t*>(m_enter(context, entry));
+    }
+}
+}
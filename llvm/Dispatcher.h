@@ -0,0 +1,46 @@
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+#include <stddef.h>
+#include <stdint.h>
+#include "PlatformDesc.h"
+
+namespace jit {
+class TranslationCache;
+class BlockChainer;
+
+// Runs guest code until the translator gives up. Every exit of a translation
+// stores the next guest pc in the context and returns to the dispatcher, which
+// either enters the cached translation or asks for a new one.
+class Dispatcher {
+public:
+    // Host glue entering a translation with |context|; returns once the
+    // translation exits through one of its patch points. A direct exit
+    // returns the end of its patch area, any other exit returns null.
+    typedef void* (*EnterFunction)(void* context, void* entry);
+    // Translates and links |pc|. Returns the entry point, or nullptr to stop.
+    typedef void* (*TranslateFunction)(void* opaque, uintptr_t pc);
+
+    Dispatcher(TranslationCache& cache, const PlatformDesc& desc, EnterFunction enter, TranslateFunction translate, void* opaque, BlockChainer* chainer = nullptr);
+
+    void run(void* context);
+
+    inline uintptr_t guestPC(void* context) const
+    {
+        return *reinterpret_cast<uintptr_t*>(static_cast<uint8_t*>(context) + m_desc.m_pcFieldOffset);
+    }
+
+    inline uint64_t dispatches() const { return m_dispatches; }
+    inline uint64_t translations() const { return m_translations; }
+
+private:
+    TranslationCache& m_cache;
+    BlockChainer* m_chainer;
+    PlatformDesc m_desc;
+    EnterFunction m_enter;
+    TranslateFunction m_translate;
+    void* m_opaque;
+    uint64_t m_dispatches;
+    uint64_t m_translations;
+};
+}
+#endif /* DISPATCHER_H */
@@ -0,0 +1,63 @@
+#ifndef INDIRECTBRANCHCACHE_H
+#define INDIRECTBRANCHCACHE_H
+#include <assert.h>
+#include <stdint.h>
+#include "PlatformDesc.h"
+
+namespace jit {
+
+// Direct mapped (guest pc -> host entry) table living in the context at
+// PlatformDesc::m_indirectCacheOffset. Indirect exits probe it inline and only
+// fall back to the dispatcher on a miss; the dispatcher fills it.
+struct IndirectBranchCacheEntry {
+    uintptr_t m_pc;
+    void* m_entry;
+};
+
+// The pc of empty slots, which no indirect branch goes to. Not 0, which a
+// guest may well branch to.
+static const uintptr_t indirectBranchCacheEmptyPC = ~static_cast<uintptr_t>(0);
+
+static const uint64_t indirectBranchCacheMultiplier = 0x9E3779B97F4A7C15ULL;
+
+static inline bool validIndirectBranchCacheEntries(size_t entries)
+{
+    // One entry would need a shift by 64, which neither C++ nor LLVM define.
+    return !entries || (entries >= 2 && !(entries & (entries - 1)));
+}
+
+static inline unsigned indirectBranchCacheShift(size_t entries)
+{
+    assert(entries && validIndirectBranchCacheEntries(entries));
+    return 64 - __builtin_ctzll(entries);
+}
+
+static inline size_t indirectBranchCacheIndex(uintptr_t pc, size_t entries)
+{
+    return static_cast<size_t>((pc * indirectBranchCacheMultiplier) >> indirectBranchCacheShift(entries));
+}
+
+static inline IndirectBranchCacheEntry* indirectBranchCache(void* context, const PlatformDesc& desc)
+{
+    return reinterpret_cast<IndirectBranchCacheEntry*>(static_cast<uint8_t*>(context) + desc.m_indirectCacheOffset);
+}
+
+static inline void fillIndirectBranchCache(void* context, const PlatformDesc& desc, uintptr_t pc, void* entry)
+{
+    if (!desc.m_indirectCacheEntries)
+        return;
+    IndirectBranchCacheEntry& slot = indirectBranchCache(context, desc)[indirectBranchCacheIndex(pc, desc.m_indirectCacheEntries)];
+    slot.m_pc = pc;
+    slot.m_entry = entry;
+}
+
+static inline void clearIndirectBranchCache(void* context, const PlatformDesc& desc)
+{
+    IndirectBranchCacheEntry* slots = indirectBranchCache(context, desc);
+    for (size_t i = 0; i < desc.m_indirectCacheEntries; ++i) {
+        slots[i].m_pc = indirectBranchCacheEmptyPC;
+        slots[i].m_entry = nullptr;
+    }
+}
+}
+#endif /* INDIRECTBRANCHCACHE_H */
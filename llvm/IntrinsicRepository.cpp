@@ -1,3 +1,5 @@
+#include <assert.h>
+#include <string.h>
 #include "IntrinsicRepository.h"
 
 namespace jit {
@@ -19,4 +21,14 @@ IntrinsicRepository::IntrinsicRepository(LContext context, LModule module)
     }
 FOR_EACH_FTL_INTRINSIC(INTRINSIC_GETTER_SLOW_DEFINITION)
 #undef INTRINSIC_GETTER
+
+LValue IntrinsicRepository::overloadedIntrinsic(const char* name, LType type)
+{
+    unsigned id = LLVMLookupIntrinsicID(name, strlen(name));
+    assert(id && LLVMIntrinsicIsOverloaded(id));
+    LValue& intrinsic = m_overloaded[std::make_pair(id, type)];
+    if (!intrinsic)
+        intrinsic = LLVMGetIntrinsicDeclaration(m_module, id, &type, 1);
+    return intrinsic;
+}
 }
@@ -1,5 +1,7 @@
 #ifndef INTRINSICREPOSITORY_H
 #define INTRINSICREPOSITORY_H
+#include <map>
+#include <utility>
 #include "CommonValues.h"
 
 #define FOR_EACH_FTL_INTRINSIC(macro) \
@@ -37,6 +39,12 @@ public:
     }
     FOR_EACH_FTL_INTRINSIC(INTRINSIC_GETTER)
 #undef INTRINSIC_GETTER
+
+    // An intrinsic overloaded on one type, such as "llvm.ctpop" or
+    // "llvm.uadd.with.overflow", declared for |type|. The table above would
+    // need an entry per width.
+    LValue overloadedIntrinsic(const char* name, LType type);
+
 private:
 #define INTRINSIC_GETTER_SLOW_DECLARATION(ourName, llvmName, type) \
     LLVMValueRef ourName##IntrinsicSlow();
@@ -46,6 +54,7 @@ private:
 #define INTRINSIC_FIELD_DECLARATION(ourName, llvmName, type) LLVMValueRef m_##ourName;
     FOR_EACH_FTL_INTRINSIC(INTRINSIC_FIELD_DECLARATION)
 #undef INTRINSIC_FIELD_DECLARATION
+    std::map<std::pair<unsigned, LType>, LValue> m_overloaded;
     LContext m_context;
 };
 }
@@ -0,0 +1,77 @@
+#ifndef LAZYFLAGS_H
+#define LAZYFLAGS_H
+#include <stdint.h>
+#include "PlatformDesc.h"
+
+namespace jit {
+
+// Guest condition flags are not computed by the ops that set them. The last
+// such op is kept instead, as a descriptor of four words in the context at
+// PlatformDesc::m_flagsOffset: what it was, its result and its operands, all
+// zero extended from its width. Flags are derived from it when read, by
+// Output::buildFlag() in translated code or guestFlag() anywhere else, and
+// every exit leaves it in the context for the next block to read them from.
+enum class FlagsOp : uint64_t {
+    // and, or, xor, test: carry and overflow clear.
+    Logic,
+    Add,
+    Sub,
+};
+
+enum class Flag {
+    Zero,
+    Sign,
+    Carry,
+    Overflow,
+};
+
+struct PendingFlags {
+    // The FlagsOp, the index of the sign bit from bit 8, and from bit 16 the
+    // carry, or borrow, added in by adc or sbb.
+    uint64_t m_op;
+    uint64_t m_result;
+    uint64_t m_lhs;
+    uint64_t m_rhs;
+};
+
+static const unsigned pendingFlagsSignShift = 8;
+static const unsigned pendingFlagsCarryShift = 16;
+
+static inline uint64_t pendingFlagsOp(FlagsOp op, unsigned width, bool carryIn)
+{
+    return static_cast<uint64_t>(op) | static_cast<uint64_t>(width - 1) << pendingFlagsSignShift | static_cast<uint64_t>(carryIn) << pendingFlagsCarryShift;
+}
+
+static inline PendingFlags* pendingFlags(void* context, const PlatformDesc& desc)
+{
+    return reinterpret_cast<PendingFlags*>(static_cast<uint8_t*>(context) + desc.m_flagsOffset);
+}
+
+// The same derivation as Output::buildFlag().
+static inline bool guestFlag(const PendingFlags& flags, Flag flag)
+{
+    FlagsOp op = static_cast<FlagsOp>(flags.m_op & 0xff);
+    unsigned sign = (flags.m_op >> pendingFlagsSignShift) & 0x3f;
+    bool carryIn = (flags.m_op >> pendingFlagsCarryShift) & 1;
+    switch (flag) {
+    case Flag::Zero:
+        return !flags.m_result;
+    case Flag::Sign:
+        return (flags.m_result >> sign) & 1;
+    case Flag::Carry:
+        if (op == FlagsOp::Add)
+            return flags.m_result < flags.m_lhs || (carryIn && flags.m_result == flags.m_lhs);
+        if (op == FlagsOp::Sub)
+            return flags.m_lhs < flags.m_rhs || (carryIn && flags.m_lhs == flags.m_rhs);
+        return false;
+    case Flag::Overflow:
+        if (op == FlagsOp::Add)
+            return (((flags.m_lhs ^ flags.m_result) & (flags.m_rhs ^ flags.m_result)) >> sign) & 1;
+        if (op == FlagsOp::Sub)
+            return (((flags.m_lhs ^ flags.m_rhs) & (flags.m_lhs ^ flags.m_result)) >> sign) & 1;
+        return false;
+    }
+    __builtin_unreachable();
+}
+}
+#endif /* LAZYFLAGS_H */
@@ -1,37 +1,173 @@
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include "log.h"
 #include "StackMaps.h"
+#include "CodeCache.h"
+#include "BlockChainer.h"
 #include "CompilerState.h"
+#include "CompileStats.h"
 #include "Abbreviations.h"
 #include "Link.h"
 
 namespace jit {
 
-void link(CompilerState& state)
+// Stubs go to the code cache after the translation calling them, and so are
+// evicted after it; they need not stay pinned, as that translation is.
+static void linkAssistCall(const PlatformDesc& desc, CodeCache& codeCache, uint8_t* toFill, uint8_t* executable, const AssistCallDesc& assist)
 {
-    StackMaps sm;
-    DataView dv(state.m_stackMapsSection->data());
-    sm.parse(&dv);
-    auto rm = sm.computeRecordMap();
-    assert(state.m_codeSectionList.size() == 1);
-    uint8_t* prologue = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(state.m_codeSectionList.front().data()));
-    uint8_t* body = static_cast<uint8_t*>(state.m_entryPoint);
-    PlatformDesc& platformDesc = state.m_platformDesc;
-    state.m_platformDesc.m_patchPrologue(platformDesc.m_opaque, prologue, body);
-    for (auto& record : rm) {
-        assert(record.second.size() == 1);
-        auto found = state.m_patchMap.find(record.first);
-        assert(found != state.m_patchMap.end());
-        PatchDesc& patchDesc = found->second;
-        switch (patchDesc.m_type) {
-        case PatchType::Direct: {
-            platformDesc.m_patchDirect(platformDesc.m_opaque, body + record.second[0].instructionOffset);
-        } break;
-        case PatchType::Indirect: {
-            platformDesc.m_patchIndirect(platformDesc.m_opaque, body + record.second[0].instructionOffset);
-        } break;
+    std::vector<uint8_t> buffer(desc.m_assistStubSize);
+    size_t size = desc.m_emitAssistStub(desc.m_opaque, buffer.data(), assist);
+    assert(size <= desc.m_assistStubSize);
+    uint8_t* stub = codeCache.allocate(size, 16);
+    if (!stub) {
+        LOGE("FATAL: Code cache exhausted allocating an assist stub.");
+        assert(false);
+    }
+    memcpy(stub, buffer.data(), size);
+    uint8_t* executableStub = codeCache.executableAddress(stub);
+    codeCache.flush(executableStub, size);
+    codeCache.release(stub);
+    desc.m_patchAssistCall(desc.m_opaque, toFill, executable, executableStub);
+}
+
+void linkTranslation(const PlatformDesc& desc, CodeCache& codeCache, BlockChainer* chainer,
+    void* entryPoint, size_t size, const PatchSite* sites, size_t count)
+{
+    // Patch in place through the writable view of the code cache.
+    uint8_t* prologue = codeCache.writableAddress(entryPoint);
+    uint8_t* body = prologue + desc.m_prologueSize;
+    desc.m_patchPrologue(desc.m_opaque, prologue, body);
+    for (size_t i = 0; i < count; ++i) {
+        const PatchSite& site = sites[i];
+        switch (site.m_desc.m_type) {
+        case PatchType::Direct:
+            desc.m_patchDirect(desc.m_opaque, body + site.m_offset);
+            break;
+        case PatchType::Indirect:
+            desc.m_patchIndirect(desc.m_opaque, body + site.m_offset);
+            break;
+        case PatchType::IndirectJump:
+            desc.m_patchIndirectJump(desc.m_opaque, body + site.m_offset, site.m_reg);
+            break;
+        case PatchType::Assist:
+            desc.m_patchAssist(desc.m_opaque, body + site.m_offset);
+            break;
+        case PatchType::AssistCall:
+            linkAssistCall(desc, codeCache, body + site.m_offset, static_cast<uint8_t*>(entryPoint) + desc.m_prologueSize + site.m_offset, site.m_assist);
+            break;
         default:
             __builtin_unreachable();
         }
     }
+    codeCache.flush(entryPoint, size);
+    if (!chainer)
+        return;
+    // Exits to blocks that are already translated jump there directly.
+    uint8_t* executableBody = static_cast<uint8_t*>(entryPoint) + desc.m_prologueSize;
+    for (size_t i = 0; i < count; ++i) {
+        if (sites[i].m_desc.m_type == PatchType::Direct)
+            chainer->chain(executableBody + sites[i].m_offset, sites[i].m_desc.m_target);
+    }
+}
+
+static void fillAssistCall(const CompactStackMaps::Record& record, PatchSite& site)
+{
+    // The anyreg result, then the context and the argument.
+    assert(record.locationCount() == 3);
+    AssistCallDesc& assist = site.m_assist;
+    assist.m_helper = reinterpret_cast<void*>(site.m_desc.m_target);
+    assist.m_liveRegisters = record.liveOutsSet().to_ullong();
+    assist.m_floatLiveSize = 0;
+    for (unsigned i = 0; i < record.liveOutCount(); ++i) {
+        StackMaps::LiveOut liveOut = record.liveOut(i);
+        Reg reg = liveOut.dwarfReg.reg();
+        if (reg.val() != Reg::invalid() && reg.isFloat())
+            assist.m_floatLiveSize = std::max<unsigned>(assist.m_floatLiveSize, liveOut.size);
+    }
+    StackMaps::Location result = record.location(0);
+    StackMaps::Location context = record.location(1);
+    StackMaps::Location argument = record.location(2);
+    assert(result.kind == StackMaps::Location::Register && context.kind == StackMaps::Location::Register);
+    assist.m_result = result.dwarfReg.reg().val();
+    assist.m_context = context.dwarfReg.reg().val();
+    assist.m_argument = -1;
+    assist.m_argumentValue = 0;
+    switch (argument.kind) {
+    case StackMaps::Location::Register:
+        assist.m_argument = argument.dwarfReg.reg().val();
+        break;
+    case StackMaps::Location::Constant:
+        assist.m_argumentValue = argument.offset;
+        break;
+    default:
+        // anyreg keeps every other argument in a register.
+        assert(false);
+    }
+}
+
+void link(CompilerState& state)
+{
+    // One per thread, so that its index keeps its capacity across compiles.
+    static thread_local CompactStackMaps sm;
+    {
+        PhaseTimer timer(state.m_tier, CompilePhase::StackMapParse);
+        bool parsed = sm.parse(state.m_stackMapsSection.data());
+        assert(parsed);
+        (void)parsed;
+    }
+    PhaseTimer timer(state.m_tier, CompilePhase::Link);
+    PlatformDesc& platformDesc = state.m_platformDesc;
+    CodeCache& codeCache = state.m_codeCache;
+    // Before version 2 there is no record count, and so only one function
+    // per module.
+    assert(sm.version() >= 2 || sm.functionCount() <= 1);
+    unsigned functionIndex[8];
+    std::vector<unsigned> moreFunctions;
+    unsigned* functions = functionIndex;
+    if (sm.functionCount() > 8) {
+        moreFunctions.resize(sm.functionCount());
+        functions = moreFunctions.data();
+    }
+    for (unsigned i = 0; i < sm.functionCount(); ++i) {
+        // The function address was relocated against the writable view.
+        uint8_t* body = reinterpret_cast<uint8_t*>(sm.functionAddress(i));
+        uint8_t* entryPoint = codeCache.executableAddress(body - platformDesc.m_prologueSize);
+        auto function = std::find(state.m_entryPoints.begin(), state.m_entryPoints.end(), entryPoint);
+        assert(function != state.m_entryPoints.end());
+        functions[i] = function - state.m_entryPoints.begin();
+    }
+    state.m_patchSites.reserve(sm.recordCount());
+    for (size_t i = 0; i < sm.recordCount(); ++i) {
+        CompactStackMaps::Record record = sm.record(i);
+        auto found = state.m_patchMap.find(record.patchpointID());
+        assert(found != state.m_patchMap.end());
+        PatchSite site = { functions[record.function()], record.instructionOffset(), -1, found->second, {} };
+        if (site.m_desc.m_type == PatchType::IndirectJump) {
+            // locations[0] is the anyreg result, the jump target follows.
+            assert(record.locationCount() == 2);
+            StackMaps::Location target = record.location(1);
+            assert(target.kind == StackMaps::Location::Register);
+            site.m_reg = target.dwarfReg.reg().val();
+        } else if (site.m_desc.m_type == PatchType::AssistCall)
+            fillAssistCall(record, site);
+        state.m_patchSites.push_back(site);
+    }
+    std::stable_sort(state.m_patchSites.begin(), state.m_patchSites.end(),
+        [](const PatchSite& a, const PatchSite& b) { return a.m_function < b.m_function; });
+
+    auto site = state.m_patchSites.begin();
+    for (unsigned function = 0; function < state.m_entryPoints.size(); ++function) {
+        void* entryPoint = state.m_entryPoints[function];
+        uint8_t* data = codeCache.writableAddress(entryPoint);
+        auto code = std::find_if(state.m_codeSectionList.begin(), state.m_codeSectionList.end(),
+            [data](const CodeSection& section) { return section.m_data == data; });
+        assert(code != state.m_codeSectionList.end());
+        auto end = site;
+        while (end != state.m_patchSites.end() && end->m_function == function)
+            ++end;
+        linkTranslation(platformDesc, codeCache, state.m_chainer, entryPoint, code->m_size, &*site, end - site);
+        site = end;
+    }
 }
 }
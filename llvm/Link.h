@@ -1,7 +1,18 @@
 #ifndef LINK_H
 #define LINK_H
+#include <stddef.h>
+#include "PlatformDesc.h"
 namespace jit {
+struct CompilerState;
+struct PatchSite;
+class CodeCache;
+class BlockChainer;
 
 void link(CompilerState& state);
+// Patches the prologue and |sites| of one translation of |size| bytes
+// starting at the executable |entryPoint|, flushes it and chains its direct
+// exits when |chainer| is given.
+void linkTranslation(const PlatformDesc& desc, CodeCache& codeCache, BlockChainer* chainer,
+    void* entryPoint, size_t size, const PatchSite* sites, size_t count);
 }
 #endif /* LINK_H */
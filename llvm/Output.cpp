@@ -1,25 +1,80 @@
 #include <assert.h>
+#include <string>
 #include "CompilerState.h"
+#include "CompileStats.h"
+#include "IndirectBranchCache.h"
+#include "SoftTLB.h"
 #include "Output.h"
 
 namespace jit {
+namespace {
+struct HostTarget {
+    HostTarget()
+    {
+        char* cpu = LLVMGetHostCPUName();
+        char* features = LLVMGetHostCPUFeatures();
+        m_cpu = cpu;
+        m_features = features;
+        LLVMDisposeMessage(cpu);
+        LLVMDisposeMessage(features);
+    }
+    std::string m_cpu;
+    std::string m_features;
+};
+}
+
+static const HostTarget& hostTarget()
+{
+    static const HostTarget host;
+    return host;
+}
+
 Output::Output(CompilerState& state)
     : m_state(state)
     , m_repo(state.m_context, state.m_module)
     , m_builder(nullptr)
-    , m_stackMapsId(1)
+    // Patchpoint ids are unique across all the functions of the module.
+    , m_stackMapsId(state.m_patchMap.size() + 1)
+    , m_buildStart(monotonicNanoseconds())
+    , m_registerBuilder(nullptr)
+    , m_vectorType(nullptr)
+    , m_flags()
 {
     m_argType = pointerType(arrayType(repo().intPtr, state.m_platformDesc.m_contextSize / sizeof(intptr_t)));
     state.m_function = addFunction(
         state.m_module, "main", functionType(repo().int64, m_argType));
+    state.m_functions.push_back(state.m_function);
+    // The code runs from the executable view of the code cache, while MCJIT
+    // resolves relocations against the writable one. Keep absolute code
+    // addresses out of the output.
+    addTargetDependentFunctionAttr(state.m_function, "no-jump-tables", "true");
+    // MCJIT targets a generic x86-64, without SSE4.1 rounding, FMA or AVX:
+    // floor() and fma() would be libm calls and vectors no wider than SSE2.
+    // The host is what runs the code, so select for it. Being in the IR,
+    // this also keeps code for one CPU out of another's persistent cache.
+    const HostTarget& host = hostTarget();
+    addTargetDependentFunctionAttr(state.m_function, "target-cpu", host.m_cpu.c_str());
+    addTargetDependentFunctionAttr(state.m_function, "target-features", host.m_features.c_str());
     m_builder = LLVMCreateBuilderInContext(state.m_context);
+    m_registerBuilder = LLVMCreateBuilderInContext(state.m_context);
 
+    if (state.m_platformDesc.m_vectorCount)
+        m_vectorType = jit::vectorType(repo().int64, state.m_platformDesc.m_vectorSize / sizeof(int64_t));
     m_prologue = appendBasicBlock("Prologue");
     positionToBBEnd(m_prologue);
     buildGetArg();
+    if (state.m_platformDesc.m_exitRequestOffset)
+        buildExitRequestCheck(state.m_pc);
+    if (state.m_tierUp)
+        buildTierUpCheck(*state.m_tierUp, state.m_tierUp->m_pc);
 }
 Output::~Output()
 {
+    buildRegionExits();
+    // Only now is it known which registers are stored to.
+    buildRegisterWriteback();
+    CompileStats::shared().record(m_state.m_tier, CompilePhase::BuildIR, monotonicNanoseconds() - m_buildStart);
+    LLVMDisposeBuilder(m_registerBuilder);
     LLVMDisposeBuilder(m_builder);
 }
 
@@ -48,6 +103,21 @@ LValue Output::constIntPtr(intptr_t i)
     return jit::constInt(m_repo.intPtr, i);
 }
 
+LValue Output::constInt(LType type, unsigned long long value)
+{
+    return jit::constInt(type, value);
+}
+
+LValue Output::constReal(LType type, double value)
+{
+    return jit::constReal(type, value);
+}
+
+LType Output::intType(unsigned bits)
+{
+    return jit::intType(m_state.m_context, bits);
+}
+
 LValue Output::buildStructGEP(LValue structVal, unsigned field)
 {
     return jit::buildStructGEP(m_builder, structVal, field);
@@ -73,6 +143,11 @@ LValue Output::buildBr(LBasicBlock bb)
     return jit::buildBr(m_builder, bb);
 }
 
+LValue Output::buildCondBr(LValue condition, LBasicBlock taken, LBasicBlock notTaken)
+{
+    return jit::buildCondBr(m_builder, condition, taken, notTaken);
+}
+
 LValue Output::buildRet(LValue ret)
 {
     return jit::buildRet(m_builder, ret);
@@ -91,31 +166,213 @@ LValue Output::buildCast(LLVMOpcode Op, LLVMValueRef Val, LLVMTypeRef DestTy)
 void Output::buildGetArg()
 {
     m_arg = LLVMGetParam(m_state.m_function, 0);
+    // Nothing else in a translation points into the context, and all of it
+    // can be read: loads of it are free to move and stores to it to die
+    // across guest memory accesses.
+    addParameterAttr(m_state.m_context, m_state.m_function, 1, "noalias");
+    addParameterAttr(m_state.m_context, m_state.m_function, 1, "dereferenceable", m_state.m_platformDesc.m_contextSize);
+}
+
+LValue Output::constPointer(const void* pointer, LType type)
+{
+    return constIntToPtr(constIntPtr(reinterpret_cast<intptr_t>(pointer)), type);
+}
+
+void Output::setUnlikely(LValue branch)
+{
+    setMetadata(branch, repo().profKind, mdNode(m_state.m_context, repo().branchWeights, constInt32(1), constInt32(2000)));
+}
+
+void Output::buildTierUpCheck(const TierUpDesc& desc, uintptr_t pc)
+{
+    LValue counter = constPointer(desc.m_counter, repo().ref64);
+    LValue count = buildAdd(buildLoad(counter), constInt64(1));
+    buildStore(count, counter);
+    LBasicBlock request = appendBasicBlock("TierUpRequest");
+    LBasicBlock check = appendBasicBlock("TierUpCheck");
+    setUnlikely(buildCondBr(buildICmp(LLVMIntEQ, count, constInt64(desc.m_threshold)), request, check));
+
+    positionToBBEnd(request);
+    LType requestType = pointerType(functionType(repo().voidType, repo().ref8));
+    buildCall(constPointer(reinterpret_cast<const void*>(desc.m_request), requestType), constPointer(desc.m_opaque, repo().ref8));
+    buildBr(check);
+
+    // Leave for the optimized code once it is published.
+    positionToBBEnd(check);
+    LBasicBlock promoted = appendBasicBlock("TierUpPromoted");
+    LBasicBlock entry = appendBasicBlock("TierUpEntry");
+    LValue ready = buildLoad(constPointer(desc.m_ready, repo().ref32));
+    LLVMSetOrdering(ready, LLVMAtomicOrderingMonotonic);
+    LLVMSetAlignment(ready, sizeof(uint32_t));
+    setUnlikely(buildCondBr(buildICmp(LLVMIntNE, ready, constInt32(0)), promoted, entry));
+
+    positionToBBEnd(promoted);
+    buildDirectPatch(pc);
+    positionToBBEnd(entry);
+}
+
+void Output::buildExitRequestCheck(uintptr_t pc)
+{
+    // Chained translations, and loops within a region, run on without the
+    // dispatcher.
+    const PlatformDesc& platformDesc = m_state.m_platformDesc;
+    LValue request = buildContextLoad(m_builder, platformDesc.m_exitRequestOffset / sizeof(intptr_t));
+    LLVMSetOrdering(request, LLVMAtomicOrderingMonotonic);
+    LLVMSetAlignment(request, sizeof(intptr_t));
+    LBasicBlock exit = appendBasicBlock("ExitRequested");
+    LBasicBlock next = appendBasicBlock("ExitRequestEntry");
+    setUnlikely(buildCondBr(buildICmp(LLVMIntNE, request, constIntPtr(0)), exit, next));
+
+    // Exits as an indirect branch would, so that it is never chained, to
+    // this very translation as likely as not.
+    positionToBBEnd(exit);
+    PatchDesc desc = { PatchType::Indirect, 0 };
+    buildPatchCommon(constInt64(pc), desc, platformDesc.m_indirectSize);
+    positionToBBEnd(next);
 }
 
 void Output::buildDirectPatch(uintptr_t where)
 {
-    PatchDesc desc = { PatchType::Direct };
+    PatchDesc desc = { PatchType::Direct, where };
     buildPatchCommon(constInt64(where), desc, m_state.m_platformDesc.m_directSize);
 }
 
+void Output::buildSideExit(LValue condition, uintptr_t target)
+{
+    LBasicBlock exit = appendBasicBlock("SideExit");
+    LBasicBlock next = appendBasicBlock("Trace");
+    setUnlikely(buildCondBr(condition, exit, next));
+    positionToBBEnd(exit);
+    buildDirectPatch(target);
+    positionToBBEnd(next);
+}
+
+LBasicBlock Output::regionBlock(uintptr_t pc)
+{
+    auto found = m_regionBlocks.find(pc);
+    if (found != m_regionBlocks.end()) {
+        if (found->second.m_started)
+            m_state.m_hasLoops = true;
+        return found->second.m_block;
+    }
+    LBasicBlock block = appendBasicBlock("Region");
+    m_regionBlocks.insert(std::make_pair(pc, RegionBlock { block, false }));
+    return block;
+}
+
+void Output::buildRegionBlock(uintptr_t pc)
+{
+    LBasicBlock block = regionBlock(pc);
+    RegionBlock& region = m_regionBlocks[pc];
+    assert(!region.m_started);
+    region.m_started = true;
+    if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(m_builder)))
+        buildBr(block);
+    positionToBBEnd(block);
+}
+
+LBasicBlock Output::regionTarget(uintptr_t pc)
+{
+    LBasicBlock block = regionBlock(pc);
+    bool exitRequest = m_state.m_platformDesc.m_exitRequestOffset;
+    if ((!m_state.m_tierUp && !exitRequest) || !m_regionBlocks[pc].m_started)
+        return block;
+    // A back-edge counts as an entry too, or a loop entered once would never
+    // tier up, nor let the code cache evict. Either way out leaves for |pc|,
+    // where the guest is.
+    LBasicBlock current = LLVMGetInsertBlock(m_builder);
+    LBasicBlock backEdge = appendBasicBlock("RegionBackEdge");
+    positionToBBEnd(backEdge);
+    if (exitRequest)
+        buildExitRequestCheck(pc);
+    if (m_state.m_tierUp)
+        buildTierUpCheck(*m_state.m_tierUp, pc);
+    buildBr(block);
+    positionToBBEnd(current);
+    return backEdge;
+}
+
+void Output::buildRegionBranch(uintptr_t target)
+{
+    buildBr(regionTarget(target));
+}
+
+void Output::buildRegionCondBranch(LValue condition, uintptr_t taken, uintptr_t notTaken)
+{
+    buildCondBr(condition, regionTarget(taken), regionTarget(notTaken));
+}
+
+void Output::buildRegionExits()
+{
+    for (auto& entry : m_regionBlocks) {
+        if (entry.second.m_started)
+            continue;
+        positionToBBEnd(entry.second.m_block);
+        buildDirectPatch(entry.first);
+    }
+}
+
 void Output::buildIndirectPatch(LValue where)
 {
-    PatchDesc desc = { PatchType::Indirect };
-    buildPatchCommon(where, desc, m_state.m_platformDesc.m_indirectSize);
+    const PlatformDesc& platformDesc = m_state.m_platformDesc;
+    PatchDesc desc = { PatchType::Indirect, 0 };
+    if (!platformDesc.m_indirectCacheEntries) {
+        buildPatchCommon(where, desc, platformDesc.m_indirectSize);
+        return;
+    }
+    // Probe the inline cache first and only exit to the dispatcher on a miss.
+    assert(platformDesc.m_indirectCacheEntries > 1 && !(platformDesc.m_indirectCacheEntries & (platformDesc.m_indirectCacheEntries - 1)));
+    // Both ways out share the register writeback, ahead of the probe.
+    LBasicBlock probe = appendBasicBlock("IndirectProbe");
+    m_exits.push_back(buildBr(probe));
+    positionToBBEnd(probe);
+    LValue hash = jit::buildLShr(m_builder, jit::buildMul(m_builder, where, constInt64(indirectBranchCacheMultiplier)), constInt64(indirectBranchCacheShift(platformDesc.m_indirectCacheEntries)));
+    LValue slot = buildAdd(jit::buildShl(m_builder, hash, constInt64(1)), constInt64(platformDesc.m_indirectCacheOffset / sizeof(intptr_t)));
+    LValue pcIndex[] = { constInt32(0), slot };
+    LValue entryIndex[] = { constInt32(0), buildAdd(slot, constInt64(1)) };
+    LValue cachedPC = setAliasTag(buildLoad(LLVMBuildInBoundsGEP(m_builder, m_arg, pcIndex, 2, "")), repo().tbaaIndirectCache);
+    LValue cachedEntry = setAliasTag(buildLoad(LLVMBuildInBoundsGEP(m_builder, m_arg, entryIndex, 2, "")), repo().tbaaIndirectCache);
+    LBasicBlock hit = appendBasicBlock("IndirectHit");
+    LBasicBlock miss = appendBasicBlock("IndirectMiss");
+    buildCondBr(buildICmp(LLVMIntEQ, cachedPC, where), hit, miss);
+
+    positionToBBEnd(hit);
+    PatchDesc jumpDesc = { PatchType::IndirectJump, 0 };
+    buildPatchCommon(where, jumpDesc, platformDesc.m_indirectSize, cachedEntry, false);
+
+    positionToBBEnd(miss);
+    buildPatchCommon(where, desc, platformDesc.m_indirectSize, nullptr, false);
 }
 
 void Output::buildAssistPatch(LValue where)
 {
-    PatchDesc desc = { PatchType::Assist };
+    PatchDesc desc = { PatchType::Assist, 0 };
     buildPatchCommon(where, desc, m_state.m_platformDesc.m_assistSize);
 }
 
-void Output::buildPatchCommon(LValue where, const PatchDesc& desc, size_t patchSize)
+LValue Output::buildAssistCall(uintptr_t helper, LValue argument)
+{
+    PatchDesc desc = { PatchType::AssistCall, helper };
+    LValue call = buildCall(repo().patchpointInt64Intrinsic(), constIntPtr(m_stackMapsId), constInt32(m_state.m_platformDesc.m_assistCallSize), constNull(repo().ref8), constInt32(2), m_arg, argument);
+    LLVMSetInstructionCallConv(call, LLVMAnyRegCallConv);
+    m_state.m_patchMap.insert(std::make_pair(m_stackMapsId++, desc));
+    if (m_state.m_tier == Tier::Optimized)
+        m_assists.push_back(call);
+    // The helper may have set the flags.
+    m_flags.m_block = nullptr;
+    return call;
+}
+
+void Output::buildPatchCommon(LValue where, const PatchDesc& desc, size_t patchSize, LValue target, bool writeback)
 {
-    LValue constIndex[] = { constInt32(0), constInt32(m_state.m_platformDesc.m_pcFieldOffset / sizeof(intptr_t)) };
-    buildStore(where, LLVMBuildInBoundsGEP(m_builder, m_arg, constIndex, 2, ""));
-    LValue call = buildCall(repo().patchpointInt64Intrinsic(), constIntPtr(m_stackMapsId), constInt32(patchSize), constNull(repo().ref8), constInt32(0));
+    LValue pcStore = buildContextStore(m_builder, where, m_state.m_platformDesc.m_pcFieldOffset / sizeof(intptr_t));
+    if (writeback)
+        m_exits.push_back(pcStore);
+    LValue call;
+    if (target)
+        call = buildCall(repo().patchpointInt64Intrinsic(), constIntPtr(m_stackMapsId), constInt32(patchSize), constNull(repo().ref8), constInt32(1), target);
+    else
+        call = buildCall(repo().patchpointInt64Intrinsic(), constIntPtr(m_stackMapsId), constInt32(patchSize), constNull(repo().ref8), constInt32(0));
     LLVMSetInstructionCallConv(call, LLVMAnyRegCallConv);
     buildUnreachable(m_builder);
     // record the stack map info
@@ -124,14 +381,160 @@ void Output::buildPatchCommon(LValue where, const PatchDesc& desc, size_t patchS
 
 LValue Output::buildLoadArgIndex(int index)
 {
-    LValue constIndex[] = { constInt32(0), constInt32(index) };
-    return buildLoad(LLVMBuildInBoundsGEP(m_builder, m_arg, constIndex, 2, ""));
+    if (m_state.m_tier != Tier::Optimized)
+        return buildContextLoad(m_builder, index);
+    return buildLoad(registerSlot(index));
 }
 
 LValue Output::buildStoreArgIndex(LValue val, int index)
+{
+    if (m_state.m_tier != Tier::Optimized)
+        return buildContextStore(m_builder, val, index);
+    LValue slot = registerSlot(index);
+    m_dirty[index] = true;
+    return buildStore(val, slot);
+}
+
+LValue Output::buildContextSlot(LBuilder builder, int index)
 {
     LValue constIndex[] = { constInt32(0), constInt32(index) };
-    return buildStore(val, LLVMBuildInBoundsGEP(m_builder, m_arg, constIndex, 2, ""));
+    return LLVMBuildInBoundsGEP(builder, m_arg, constIndex, 2, "");
+}
+
+LValue Output::contextTag(size_t index)
+{
+    const PlatformDesc& desc = m_state.m_platformDesc;
+    size_t offset = index * sizeof(intptr_t);
+    if (offset == desc.m_pcFieldOffset)
+        return repo().tbaaPC;
+    if (desc.m_flagsOffset && offset - desc.m_flagsOffset < sizeof(PendingFlags))
+        return repo().tbaaFlags;
+    if (offset - desc.m_vectorOffset < desc.m_vectorCount * desc.m_vectorSize)
+        return repo().tbaaVectorRegisters;
+    if (offset - desc.m_indirectCacheOffset < desc.m_indirectCacheEntries * sizeof(IndirectBranchCacheEntry))
+        return repo().tbaaIndirectCache;
+    if (offset - desc.m_tlbOffset < desc.m_tlbEntries * sizeof(SoftTLBEntry))
+        return repo().tbaaSoftTLB;
+    return repo().tbaaRegisters;
+}
+
+LValue Output::setAliasTag(LValue access, LValue tag)
+{
+    setMetadata(access, repo().tbaaKind, tag);
+    return access;
+}
+
+LValue Output::buildContextLoad(LBuilder builder, int index)
+{
+    return setAliasTag(jit::buildLoad(builder, buildContextSlot(builder, index)), contextTag(index));
+}
+
+LValue Output::buildContextStore(LBuilder builder, LValue value, int index)
+{
+    return setAliasTag(jit::buildStore(builder, value, buildContextSlot(builder, index)), contextTag(index));
+}
+
+LValue Output::buildVectorContextLoad(LBuilder builder, int index)
+{
+    LValue value = jit::buildLoad(builder, buildVectorContextSlot(builder, index));
+    LLVMSetAlignment(value, m_state.m_platformDesc.m_vectorSize);
+    return setAliasTag(value, repo().tbaaVectorRegisters);
+}
+
+LValue Output::buildVectorContextStore(LBuilder builder, LValue value, int index)
+{
+    LValue store = jit::buildStore(builder, value, buildVectorContextSlot(builder, index));
+    LLVMSetAlignment(store, m_state.m_platformDesc.m_vectorSize);
+    return setAliasTag(store, repo().tbaaVectorRegisters);
+}
+
+LValue Output::registerSlot(int index)
+{
+    assert(index >= 0 && static_cast<size_t>(index) < m_state.m_platformDesc.m_contextSize / sizeof(intptr_t));
+    if (static_cast<size_t>(index) >= m_registers.size()) {
+        m_registers.resize(index + 1, nullptr);
+        m_dirty.resize(index + 1, false);
+    }
+    if (m_registers[index])
+        return m_registers[index];
+    // Load the register in the prologue, so that the value dominates every
+    // use. mem2reg only promotes allocas of the entry block.
+    LValue terminator = LLVMGetBasicBlockTerminator(m_prologue);
+    if (terminator)
+        LLVMPositionBuilderBefore(m_registerBuilder, terminator);
+    else
+        LLVMPositionBuilderAtEnd(m_registerBuilder, m_prologue);
+    LValue slot = LLVMBuildAlloca(m_registerBuilder, repo().intPtr, "");
+    jit::buildStore(m_registerBuilder, buildContextLoad(m_registerBuilder, index), slot);
+    m_registers[index] = slot;
+    return slot;
+}
+
+LValue Output::buildVectorContextSlot(LBuilder builder, int index)
+{
+    const PlatformDesc& desc = m_state.m_platformDesc;
+    assert(index >= 0 && static_cast<size_t>(index) < desc.m_vectorCount && !(desc.m_vectorOffset % desc.m_vectorSize));
+    LValue slot = buildContextSlot(builder, (desc.m_vectorOffset + index * desc.m_vectorSize) / sizeof(intptr_t));
+    return jit::buildBitCast(builder, slot, pointerType(m_vectorType));
+}
+
+LValue Output::vectorRegister(int index)
+{
+    if (static_cast<size_t>(index) >= m_vectorRegisters.size()) {
+        m_vectorRegisters.resize(index + 1, nullptr);
+        m_vectorDirty.resize(index + 1, false);
+    }
+    if (m_vectorRegisters[index])
+        return m_vectorRegisters[index];
+    // In the prologue, as registerSlot() does.
+    LValue terminator = LLVMGetBasicBlockTerminator(m_prologue);
+    if (terminator)
+        LLVMPositionBuilderBefore(m_registerBuilder, terminator);
+    else
+        LLVMPositionBuilderAtEnd(m_registerBuilder, m_prologue);
+    LValue slot = LLVMBuildAlloca(m_registerBuilder, m_vectorType, "");
+    jit::buildStore(m_registerBuilder, buildVectorContextLoad(m_registerBuilder, index), slot);
+    m_vectorRegisters[index] = slot;
+    return slot;
+}
+
+void Output::buildRegisterStores()
+{
+    for (size_t i = 0; i < m_registers.size(); ++i) {
+        if (m_dirty[i])
+            buildContextStore(m_registerBuilder, jit::buildLoad(m_registerBuilder, m_registers[i]), i);
+    }
+    for (size_t i = 0; i < m_vectorRegisters.size(); ++i) {
+        if (m_vectorDirty[i])
+            buildVectorContextStore(m_registerBuilder, jit::buildLoad(m_registerBuilder, m_vectorRegisters[i]), i);
+    }
+}
+
+void Output::buildRegisterReloads()
+{
+    for (size_t i = 0; i < m_registers.size(); ++i) {
+        if (m_registers[i])
+            jit::buildStore(m_registerBuilder, buildContextLoad(m_registerBuilder, i), m_registers[i]);
+    }
+    for (size_t i = 0; i < m_vectorRegisters.size(); ++i) {
+        if (m_vectorRegisters[i])
+            jit::buildStore(m_registerBuilder, buildVectorContextLoad(m_registerBuilder, i), m_vectorRegisters[i]);
+    }
+}
+
+void Output::buildRegisterWriteback()
+{
+    for (LValue exit : m_exits) {
+        LLVMPositionBuilderBefore(m_registerBuilder, exit);
+        buildRegisterStores();
+    }
+    for (LValue assist : m_assists) {
+        LLVMPositionBuilderBefore(m_registerBuilder, assist);
+        buildRegisterStores();
+        // The helper may have changed any of them.
+        LLVMPositionBuilderBefore(m_registerBuilder, LLVMGetNextInstruction(assist));
+        buildRegisterReloads();
+    }
 }
 
 LValue Output::buildSelect(LValue condition, LValue taken, LValue notTaken)
@@ -143,4 +546,629 @@ LValue Output::buildICmp(LIntPredicate cond, LValue left, LValue right)
 {
     return jit::buildICmp(m_builder, cond, left, right);
 }
+
+LValue Output::buildFCmp(LRealPredicate cond, LValue left, LValue right)
+{
+    return jit::buildFCmp(m_builder, cond, left, right);
+}
+
+LValue Output::buildIntrinsic(const char* name, LValue value)
+{
+    return buildCall(repo().overloadedIntrinsic(name, typeOf(value)), value);
+}
+
+LValue Output::buildIntrinsic(const char* name, LValue lhs, LValue rhs)
+{
+    return buildCall(repo().overloadedIntrinsic(name, typeOf(lhs)), lhs, rhs);
+}
+
+LValue Output::buildSub(LValue lhs, LValue rhs)
+{
+    return jit::buildSub(m_builder, lhs, rhs);
+}
+
+LValue Output::buildMul(LValue lhs, LValue rhs)
+{
+    return jit::buildMul(m_builder, lhs, rhs);
+}
+
+LValue Output::buildDiv(LValue lhs, LValue rhs, Signedness signedness)
+{
+    if (signedness == Signed)
+        return jit::buildDiv(m_builder, lhs, rhs);
+    return jit::buildUDiv(m_builder, lhs, rhs);
+}
+
+LValue Output::buildRem(LValue lhs, LValue rhs, Signedness signedness)
+{
+    if (signedness == Signed)
+        return jit::buildRem(m_builder, lhs, rhs);
+    return jit::buildURem(m_builder, lhs, rhs);
+}
+
+LValue Output::buildNeg(LValue value)
+{
+    return jit::buildNeg(m_builder, value);
+}
+
+LValue Output::buildMulHigh(LValue lhs, LValue rhs, Signedness signedness)
+{
+    unsigned bits = LLVMGetIntTypeWidth(typeOf(lhs));
+    BitExtension extension = signedness == Signed ? SignExtend : ZeroExtend;
+    LValue product = buildMul(buildExtend(lhs, 2 * bits, extension), buildExtend(rhs, 2 * bits, extension));
+    return buildExtractBits(product, bits, bits);
+}
+
+LValue Output::buildAnd(LValue lhs, LValue rhs)
+{
+    return jit::buildAnd(m_builder, lhs, rhs);
+}
+
+LValue Output::buildOr(LValue lhs, LValue rhs)
+{
+    return jit::buildOr(m_builder, lhs, rhs);
+}
+
+LValue Output::buildXor(LValue lhs, LValue rhs)
+{
+    return jit::buildXor(m_builder, lhs, rhs);
+}
+
+LValue Output::buildNot(LValue value)
+{
+    return jit::buildNot(m_builder, value);
+}
+
+LValue Output::castCount(LValue count, LType type)
+{
+    return LLVMBuildIntCast2(m_builder, count, type, false, "");
+}
+
+// LLVM shifts by the width or more are poison, so the count is masked.
+LValue Output::buildShl(LValue value, LValue count)
+{
+    LType type = typeOf(value);
+    return jit::buildShl(m_builder, value, buildAnd(castCount(count, type), constInt(type, LLVMGetIntTypeWidth(type) - 1)));
+}
+
+LValue Output::buildLShr(LValue value, LValue count)
+{
+    LType type = typeOf(value);
+    return jit::buildLShr(m_builder, value, buildAnd(castCount(count, type), constInt(type, LLVMGetIntTypeWidth(type) - 1)));
+}
+
+LValue Output::buildAShr(LValue value, LValue count)
+{
+    LType type = typeOf(value);
+    return jit::buildAShr(m_builder, value, buildAnd(castCount(count, type), constInt(type, LLVMGetIntTypeWidth(type) - 1)));
+}
+
+// Funnel shifts of a value with itself, which take the count modulo the
+// width and become rol and ror.
+LValue Output::buildRotateLeft(LValue value, LValue count)
+{
+    LType type = typeOf(value);
+    return buildCall(repo().overloadedIntrinsic("llvm.fshl", type), value, value, castCount(count, type));
+}
+
+LValue Output::buildRotateRight(LValue value, LValue count)
+{
+    LType type = typeOf(value);
+    return buildCall(repo().overloadedIntrinsic("llvm.fshr", type), value, value, castCount(count, type));
+}
+
+ArithmeticResult Output::buildAddWithFlags(LValue lhs, LValue rhs, LValue carryIn)
+{
+    LValue sum = buildIntrinsic("llvm.uadd.with.overflow", lhs, rhs);
+    ArithmeticResult result = { buildExtractValue(m_builder, sum, 0), buildExtractValue(m_builder, sum, 1), nullptr };
+    if (!carryIn) {
+        result.m_overflow = buildExtractValue(m_builder, buildIntrinsic("llvm.sadd.with.overflow", lhs, rhs), 1);
+        return result;
+    }
+    sum = buildIntrinsic("llvm.uadd.with.overflow", result.m_value, jit::buildZExt(m_builder, carryIn, typeOf(lhs)));
+    result.m_value = buildExtractValue(m_builder, sum, 0);
+    result.m_carry = buildOr(result.m_carry, buildExtractValue(m_builder, sum, 1));
+    // Operands of the same sign, and a result of the other.
+    LValue signs = buildAnd(buildXor(lhs, result.m_value), buildXor(rhs, result.m_value));
+    result.m_overflow = buildICmp(LLVMIntSLT, signs, constInt(typeOf(lhs), 0));
+    return result;
+}
+
+ArithmeticResult Output::buildSubWithFlags(LValue lhs, LValue rhs, LValue borrowIn)
+{
+    LValue difference = buildIntrinsic("llvm.usub.with.overflow", lhs, rhs);
+    ArithmeticResult result = { buildExtractValue(m_builder, difference, 0), buildExtractValue(m_builder, difference, 1), nullptr };
+    if (!borrowIn) {
+        result.m_overflow = buildExtractValue(m_builder, buildIntrinsic("llvm.ssub.with.overflow", lhs, rhs), 1);
+        return result;
+    }
+    difference = buildIntrinsic("llvm.usub.with.overflow", result.m_value, jit::buildZExt(m_builder, borrowIn, typeOf(lhs)));
+    result.m_value = buildExtractValue(m_builder, difference, 0);
+    result.m_carry = buildOr(result.m_carry, buildExtractValue(m_builder, difference, 1));
+    // Operands of different signs, and a result of the sign of |rhs|.
+    LValue signs = buildAnd(buildXor(lhs, rhs), buildXor(lhs, result.m_value));
+    result.m_overflow = buildICmp(LLVMIntSLT, signs, constInt(typeOf(lhs), 0));
+    return result;
+}
+
+ArithmeticResult Output::buildMulWithFlags(LValue lhs, LValue rhs, Signedness signedness)
+{
+    LValue product = buildIntrinsic(signedness == Signed ? "llvm.smul.with.overflow" : "llvm.umul.with.overflow", lhs, rhs);
+    LValue overflow = buildExtractValue(m_builder, product, 1);
+    ArithmeticResult result = { buildExtractValue(m_builder, product, 0), overflow, overflow };
+    return result;
+}
+
+LValue Output::buildCountLeadingZeros(LValue value)
+{
+    return buildCall(repo().overloadedIntrinsic("llvm.ctlz", typeOf(value)), value, repo().booleanFalse);
+}
+
+LValue Output::buildCountTrailingZeros(LValue value)
+{
+    return buildCall(repo().overloadedIntrinsic("llvm.cttz", typeOf(value)), value, repo().booleanFalse);
+}
+
+LValue Output::buildPopCount(LValue value)
+{
+    return buildIntrinsic("llvm.ctpop", value);
+}
+
+LValue Output::buildByteSwap(LValue value)
+{
+    return buildIntrinsic("llvm.bswap", value);
+}
+
+LValue Output::buildTrunc(LValue value, unsigned bits)
+{
+    return jit::buildTrunc(m_builder, value, intType(bits));
+}
+
+LValue Output::buildExtend(LValue value, unsigned bits, BitExtension extension)
+{
+    if (extension == SignExtend)
+        return jit::buildSExt(m_builder, value, intType(bits));
+    return jit::buildZExt(m_builder, value, intType(bits));
+}
+
+LValue Output::buildExtractBits(LValue value, unsigned offset, unsigned bits)
+{
+    assert(offset + bits <= LLVMGetIntTypeWidth(typeOf(value)));
+    if (offset)
+        value = jit::buildLShr(m_builder, value, constInt(typeOf(value), offset));
+    return bits == LLVMGetIntTypeWidth(typeOf(value)) ? value : buildTrunc(value, bits);
+}
+
+LValue Output::buildInsertBits(LValue value, LValue field, unsigned offset)
+{
+    LType type = typeOf(value);
+    unsigned width = LLVMGetIntTypeWidth(type);
+    unsigned bits = LLVMGetIntTypeWidth(typeOf(field));
+    assert(offset + bits <= width && width <= 64);
+    if (bits == width)
+        return field;
+    unsigned long long mask = ((1ULL << bits) - 1) << offset;
+    LValue shifted = jit::buildZExt(m_builder, field, type);
+    if (offset)
+        shifted = jit::buildShl(m_builder, shifted, constInt(type, offset));
+    return buildOr(buildAnd(value, constInt(type, ~mask)), shifted);
+}
+
+LValue Output::buildStorePartialArgIndex(LValue field, int index, unsigned offset)
+{
+    return buildStoreArgIndex(buildInsertBits(buildLoadArgIndex(index), field, offset), index);
+}
+
+LValue Output::buildFAdd(LValue lhs, LValue rhs)
+{
+    return jit::buildFAdd(m_builder, lhs, rhs);
+}
+
+LValue Output::buildFSub(LValue lhs, LValue rhs)
+{
+    return jit::buildFSub(m_builder, lhs, rhs);
+}
+
+LValue Output::buildFMul(LValue lhs, LValue rhs)
+{
+    return jit::buildFMul(m_builder, lhs, rhs);
+}
+
+LValue Output::buildFDiv(LValue lhs, LValue rhs)
+{
+    return jit::buildFDiv(m_builder, lhs, rhs);
+}
+
+LValue Output::buildFNeg(LValue value)
+{
+    return jit::buildFNeg(m_builder, value);
+}
+
+LValue Output::buildFAbs(LValue value)
+{
+    return buildIntrinsic("llvm.fabs", value);
+}
+
+LValue Output::buildFSqrt(LValue value)
+{
+    return buildIntrinsic("llvm.sqrt", value);
+}
+
+LValue Output::buildFFloor(LValue value)
+{
+    return buildIntrinsic("llvm.floor", value);
+}
+
+LValue Output::buildFCeil(LValue value)
+{
+    return buildIntrinsic("llvm.ceil", value);
+}
+
+LValue Output::buildFTrunc(LValue value)
+{
+    return buildIntrinsic("llvm.trunc", value);
+}
+
+LValue Output::buildFRint(LValue value)
+{
+    return buildIntrinsic("llvm.rint", value);
+}
+
+LValue Output::buildFMin(LValue lhs, LValue rhs)
+{
+    return buildIntrinsic("llvm.minnum", lhs, rhs);
+}
+
+LValue Output::buildFMax(LValue lhs, LValue rhs)
+{
+    return buildIntrinsic("llvm.maxnum", lhs, rhs);
+}
+
+LValue Output::buildFMulAdd(LValue lhs, LValue rhs, LValue addend)
+{
+    return buildCall(repo().overloadedIntrinsic("llvm.fma", typeOf(lhs)), lhs, rhs, addend);
+}
+
+LValue Output::buildFCopySign(LValue magnitude, LValue sign)
+{
+    return buildIntrinsic("llvm.copysign", magnitude, sign);
+}
+
+int Output::flagsSlot(unsigned word) const
+{
+    assert(m_state.m_platformDesc.m_flagsOffset);
+    return m_state.m_platformDesc.m_flagsOffset / sizeof(intptr_t) + word;
+}
+
+void Output::setFlags(FlagsOp op, LValue result, LValue lhs, LValue rhs, LValue carryIn)
+{
+    unsigned width = LLVMGetIntTypeWidth(typeOf(result));
+    assert(width <= 64);
+    LValue word = constIntPtr(pendingFlagsOp(op, width, false));
+    if (carryIn)
+        word = buildOr(word, jit::buildShl(m_builder, buildExtend(carryIn, 64, ZeroExtend), constIntPtr(pendingFlagsCarryShift)));
+    buildStoreArgIndex(word, flagsSlot(0));
+    LValue values[] = { result, lhs, rhs };
+    for (unsigned i = 0; i < 3; ++i)
+        buildStoreArgIndex(width < 64 ? buildExtend(values[i], 64, ZeroExtend) : values[i], flagsSlot(1 + i));
+    m_flags = { LLVMGetInsertBlock(m_builder), op, result, lhs, rhs, carryIn };
+}
+
+LValue Output::buildFlag(Flag flag)
+{
+    if (m_flags.m_block != LLVMGetInsertBlock(m_builder))
+        return buildFlagFromPending(flag);
+    const KnownFlags& known = m_flags;
+    LValue zero = constInt(typeOf(known.m_result), 0);
+    switch (flag) {
+    case Flag::Zero:
+        return buildICmp(LLVMIntEQ, known.m_result, zero);
+    case Flag::Sign:
+        return buildICmp(LLVMIntSLT, known.m_result, zero);
+    case Flag::Carry: {
+        if (known.m_op == FlagsOp::Logic)
+            return repo().booleanFalse;
+        LValue first = known.m_op == FlagsOp::Add ? known.m_result : known.m_lhs;
+        LValue second = known.m_op == FlagsOp::Add ? known.m_lhs : known.m_rhs;
+        LValue carry = buildICmp(LLVMIntULT, first, second);
+        if (known.m_carryIn)
+            carry = buildOr(carry, buildAnd(known.m_carryIn, buildICmp(LLVMIntEQ, first, second)));
+        return carry;
+    }
+    case Flag::Overflow:
+        if (known.m_op == FlagsOp::Logic)
+            return repo().booleanFalse;
+        if (known.m_op == FlagsOp::Add)
+            return buildICmp(LLVMIntSLT, buildAnd(buildXor(known.m_lhs, known.m_result), buildXor(known.m_rhs, known.m_result)), zero);
+        return buildICmp(LLVMIntSLT, buildAnd(buildXor(known.m_lhs, known.m_rhs), buildXor(known.m_lhs, known.m_result)), zero);
+    }
+    __builtin_unreachable();
+}
+
+// Whatever op the flags come from: once the descriptor is known, as when it
+// was stored earlier in the function, this folds down to the above.
+LValue Output::buildFlagFromPending(Flag flag)
+{
+    LValue word = buildLoadArgIndex(flagsSlot(0));
+    LValue result = buildLoadArgIndex(flagsSlot(1));
+    LValue sign = buildAnd(jit::buildLShr(m_builder, word, constIntPtr(pendingFlagsSignShift)), constIntPtr(0x3f));
+    if (flag == Flag::Zero)
+        return buildICmp(LLVMIntEQ, result, constIntPtr(0));
+    if (flag == Flag::Sign)
+        return buildTrunc(jit::buildLShr(m_builder, result, sign), 1);
+    LValue lhs = buildLoadArgIndex(flagsSlot(2));
+    LValue rhs = buildLoadArgIndex(flagsSlot(3));
+    LValue op = buildAnd(word, constIntPtr(0xff));
+    LValue isAdd = buildICmp(LLVMIntEQ, op, constIntPtr(static_cast<intptr_t>(FlagsOp::Add)));
+    LValue isSub = buildICmp(LLVMIntEQ, op, constIntPtr(static_cast<intptr_t>(FlagsOp::Sub)));
+    LValue addFlag, subFlag;
+    if (flag == Flag::Carry) {
+        LValue carryIn = buildTrunc(jit::buildLShr(m_builder, word, constIntPtr(pendingFlagsCarryShift)), 1);
+        addFlag = buildOr(buildICmp(LLVMIntULT, result, lhs), buildAnd(carryIn, buildICmp(LLVMIntEQ, result, lhs)));
+        subFlag = buildOr(buildICmp(LLVMIntULT, lhs, rhs), buildAnd(carryIn, buildICmp(LLVMIntEQ, lhs, rhs)));
+    } else {
+        addFlag = buildTrunc(jit::buildLShr(m_builder, buildAnd(buildXor(lhs, result), buildXor(rhs, result)), sign), 1);
+        subFlag = buildTrunc(jit::buildLShr(m_builder, buildAnd(buildXor(lhs, rhs), buildXor(lhs, result)), sign), 1);
+    }
+    return buildSelect(isAdd, addFlag, buildSelect(isSub, subFlag, repo().booleanFalse));
+}
+
+LValue Output::buildFlagsCondition(LIntPredicate predicate)
+{
+    if (m_flags.m_block == LLVMGetInsertBlock(m_builder) && m_flags.m_op == FlagsOp::Sub && !m_flags.m_carryIn)
+        return buildICmp(predicate, m_flags.m_lhs, m_flags.m_rhs);
+    switch (predicate) {
+    case LLVMIntEQ:
+        return buildFlag(Flag::Zero);
+    case LLVMIntNE:
+        return buildNot(buildFlag(Flag::Zero));
+    case LLVMIntULT:
+        return buildFlag(Flag::Carry);
+    case LLVMIntUGE:
+        return buildNot(buildFlag(Flag::Carry));
+    case LLVMIntULE:
+        return buildOr(buildFlag(Flag::Carry), buildFlag(Flag::Zero));
+    case LLVMIntUGT:
+        return buildNot(buildOr(buildFlag(Flag::Carry), buildFlag(Flag::Zero)));
+    case LLVMIntSLT:
+        return buildXor(buildFlag(Flag::Sign), buildFlag(Flag::Overflow));
+    case LLVMIntSGE:
+        return buildNot(buildXor(buildFlag(Flag::Sign), buildFlag(Flag::Overflow)));
+    case LLVMIntSLE:
+        return buildOr(buildFlag(Flag::Zero), buildXor(buildFlag(Flag::Sign), buildFlag(Flag::Overflow)));
+    case LLVMIntSGT:
+        return buildNot(buildOr(buildFlag(Flag::Zero), buildXor(buildFlag(Flag::Sign), buildFlag(Flag::Overflow))));
+    }
+    __builtin_unreachable();
+}
+
+static unsigned typeBits(LType type)
+{
+    switch (LLVMGetTypeKind(type)) {
+    case LLVMIntegerTypeKind:
+        return LLVMGetIntTypeWidth(type);
+    case LLVMFloatTypeKind:
+        return 32;
+    case LLVMDoubleTypeKind:
+        return 64;
+    case LLVMVectorTypeKind:
+        return typeBits(LLVMGetElementType(type)) * LLVMGetVectorSize(type);
+    default:
+        __builtin_unreachable();
+    }
+}
+
+LValue Output::vectorPart(LValue vector, unsigned from, unsigned count)
+{
+    std::vector<LValue> lanes;
+    for (unsigned i = 0; i < count; ++i)
+        lanes.push_back(constInt32(from + i));
+    return LLVMBuildShuffleVector(m_builder, vector, getUndef(typeOf(vector)), LLVMConstVector(lanes.data(), count), "");
+}
+
+LValue Output::buildHostAddress(LValue address, unsigned size, bool store)
+{
+    const PlatformDesc& desc = m_state.m_platformDesc;
+    LValue guest = jit::buildZExt(m_builder, address, repo().int64);
+    if (!desc.m_tlbEntries)
+        return buildAdd(guest, constIntPtr(desc.m_guestMemoryBase));
+    assert(!(desc.m_tlbEntries & (desc.m_tlbEntries - 1)) && !(desc.m_tlbOffset % sizeof(SoftTLBEntry)));
+    // The page of the last byte, for accesses crossing a page to miss.
+    uint64_t pageMask = ~((static_cast<uint64_t>(1) << desc.m_tlbPageShift) - 1);
+    LValue page = buildAnd(buildAdd(guest, constInt64(size - 1)), constInt64(pageMask));
+    LValue index = buildAnd(jit::buildLShr(m_builder, guest, constInt64(desc.m_tlbPageShift)), constInt64(desc.m_tlbEntries - 1));
+    const size_t entrySlots = sizeof(SoftTLBEntry) / sizeof(intptr_t);
+    LValue slot = buildAdd(buildMul(index, constInt64(entrySlots)), constInt64(desc.m_tlbOffset / sizeof(intptr_t)));
+    size_t tagSlot = (store ? offsetof(SoftTLBEntry, m_writeTag) : offsetof(SoftTLBEntry, m_readTag)) / sizeof(intptr_t);
+    LValue tagIndex[] = { constInt32(0), buildAdd(slot, constInt64(tagSlot)) };
+    LValue addendIndex[] = { constInt32(0), buildAdd(slot, constInt64(offsetof(SoftTLBEntry, m_addend) / sizeof(intptr_t))) };
+    LValue tag = setAliasTag(buildLoad(LLVMBuildInBoundsGEP(m_builder, m_arg, tagIndex, 2, "")), repo().tbaaSoftTLB);
+    LBasicBlock hit = appendBasicBlock("TLBHit");
+    LBasicBlock miss = appendBasicBlock("TLBMiss");
+    LBasicBlock done = appendBasicBlock("TLBDone");
+    setUnlikely(buildCondBr(buildICmp(LLVMIntNE, tag, page), miss, hit));
+
+    positionToBBEnd(hit);
+    LValue fast = buildAdd(guest, setAliasTag(buildLoad(LLVMBuildInBoundsGEP(m_builder, m_arg, addendIndex, 2, "")), repo().tbaaSoftTLB));
+    buildBr(done);
+
+    positionToBBEnd(miss);
+    assert(size && !(size & (size - 1)) && static_cast<unsigned>(__builtin_ctz(size)) < tlbAccessSizes);
+    void* helper = (store ? desc.m_tlbStoreMiss : desc.m_tlbLoadMiss)[__builtin_ctz(size)];
+    assert(helper);
+    LValue slow = buildAssistCall(reinterpret_cast<uintptr_t>(helper), guest);
+    LBasicBlock missEnd = LLVMGetInsertBlock(m_builder);
+    buildBr(done);
+
+    positionToBBEnd(done);
+    LValue host = buildPhi(m_builder, repo().int64);
+    addIncoming(host, &fast, &hit, 1);
+    addIncoming(host, &slow, &missEnd, 1);
+    return host;
+}
+
+LValue Output::buildGuestLoad(LValue address, LType type)
+{
+    LValue host = buildHostAddress(address, typeBits(type) / 8, false);
+    LValue load = buildLoad(jit::buildIntToPtr(m_builder, host, pointerType(type)));
+    LLVMSetAlignment(load, 1);
+    return setAliasTag(load, repo().tbaaGuestMemory);
+}
+
+LValue Output::buildGuestStore(LValue value, LValue address)
+{
+    LType type = typeOf(value);
+    LValue host = buildHostAddress(address, typeBits(type) / 8, true);
+    LValue store = buildStore(value, jit::buildIntToPtr(m_builder, host, pointerType(type)));
+    LLVMSetAlignment(store, 1);
+    return setAliasTag(store, repo().tbaaGuestMemory);
+}
+
+LValue Output::buildLoadVectorRegister(int index)
+{
+    if (m_state.m_tier != Tier::Optimized)
+        return buildVectorContextLoad(m_builder, index);
+    return buildLoad(vectorRegister(index));
+}
+
+LValue Output::buildLoadVector(int index, LType type)
+{
+    LValue value = buildLoadVectorRegister(index);
+    // Registers are handled in 64-bit lanes; narrower parts go through
+    // buildExtractLane() on one of those.
+    assert(typeBits(type) >= 64 && !(typeBits(type) % 64));
+    unsigned words = typeBits(type) / 64;
+    assert(words <= LLVMGetVectorSize(m_vectorType));
+    if (words < LLVMGetVectorSize(m_vectorType))
+        value = vectorPart(value, 0, words);
+    return buildBitCast(value, type);
+}
+
+LValue Output::buildStoreVector(LValue value, int index)
+{
+    unsigned registerWords = LLVMGetVectorSize(m_vectorType);
+    assert(typeBits(typeOf(value)) >= 64 && !(typeBits(typeOf(value)) % 64));
+    unsigned words = typeBits(typeOf(value)) / 64;
+    assert(words <= registerWords);
+    value = buildBitCast(value, jit::vectorType(repo().int64, words));
+    if (words < registerWords) {
+        // Widen, then take the low lanes from |value| and the rest from the
+        // register.
+        LValue old = buildLoadVectorRegister(index);
+        std::vector<LValue> lanes;
+        for (unsigned i = 0; i < registerWords; ++i)
+            lanes.push_back(i < words ? constInt32(i) : getUndef(repo().int32));
+        LValue widened = LLVMBuildShuffleVector(m_builder, value, getUndef(typeOf(value)), LLVMConstVector(lanes.data(), registerWords), "");
+        lanes.clear();
+        for (unsigned i = 0; i < registerWords; ++i)
+            lanes.push_back(constInt32(i < words ? registerWords + i : i));
+        value = LLVMBuildShuffleVector(m_builder, old, widened, LLVMConstVector(lanes.data(), registerWords), "");
+    }
+    if (m_state.m_tier != Tier::Optimized)
+        return buildVectorContextStore(m_builder, value, index);
+    LValue slot = vectorRegister(index);
+    m_vectorDirty[index] = true;
+    return buildStore(value, slot);
+}
+
+LType Output::vectorType(LType element, unsigned count)
+{
+    return jit::vectorType(element, count);
+}
+
+LValue Output::buildBitCast(LValue value, LType type)
+{
+    if (typeOf(value) == type)
+        return value;
+    return jit::buildBitCast(m_builder, value, type);
+}
+
+LValue Output::buildSplat(LValue scalar, unsigned count)
+{
+    LValue vector = LLVMBuildInsertElement(m_builder, getUndef(jit::vectorType(typeOf(scalar), count)), scalar, constInt32(0), "");
+    std::vector<LValue> lanes(count, constInt32(0));
+    return LLVMBuildShuffleVector(m_builder, vector, getUndef(typeOf(vector)), LLVMConstVector(lanes.data(), count), "");
+}
+
+LValue Output::buildExtractLane(LValue vector, unsigned lane)
+{
+    return LLVMBuildExtractElement(m_builder, vector, constInt32(lane), "");
+}
+
+LValue Output::buildInsertLane(LValue vector, LValue scalar, unsigned lane)
+{
+    return LLVMBuildInsertElement(m_builder, vector, scalar, constInt32(lane), "");
+}
+
+LValue Output::buildShuffle(LValue lhs, LValue rhs, const int* lanes, unsigned count)
+{
+    std::vector<LValue> mask;
+    for (unsigned i = 0; i < count; ++i)
+        mask.push_back(lanes[i] < 0 ? getUndef(repo().int32) : constInt32(lanes[i]));
+    return LLVMBuildShuffleVector(m_builder, lhs, rhs, LLVMConstVector(mask.data(), count), "");
+}
+
+LValue Output::buildVectorICmp(LIntPredicate predicate, LValue lhs, LValue rhs)
+{
+    return jit::buildSExt(m_builder, buildICmp(predicate, lhs, rhs), typeOf(lhs));
+}
+
+LValue Output::buildVectorFCmp(LRealPredicate predicate, LValue lhs, LValue rhs)
+{
+    LType type = typeOf(lhs);
+    unsigned lanes = LLVMGetVectorSize(type);
+    LType lane = intType(typeBits(type) / lanes);
+    return jit::buildSExt(m_builder, buildFCmp(predicate, lhs, rhs), jit::vectorType(lane, lanes));
+}
+
+LValue Output::buildVectorBlend(LValue mask, LValue taken, LValue notTaken)
+{
+    LValue sign = buildICmp(LLVMIntSLT, mask, constNull(typeOf(mask)));
+    return buildSelect(sign, taken, notTaken);
+}
+
+LValue Output::buildVectorShl(LValue value, unsigned count)
+{
+    LType type = typeOf(value);
+    if (count >= LLVMGetIntTypeWidth(LLVMGetElementType(type)))
+        return constNull(type);
+    return jit::buildShl(m_builder, value, buildSplat(constInt(LLVMGetElementType(type), count), LLVMGetVectorSize(type)));
+}
+
+LValue Output::buildVectorLShr(LValue value, unsigned count)
+{
+    LType type = typeOf(value);
+    if (count >= LLVMGetIntTypeWidth(LLVMGetElementType(type)))
+        return constNull(type);
+    return jit::buildLShr(m_builder, value, buildSplat(constInt(LLVMGetElementType(type), count), LLVMGetVectorSize(type)));
+}
+
+LValue Output::buildVectorAShr(LValue value, unsigned count)
+{
+    LType type = typeOf(value);
+    unsigned width = LLVMGetIntTypeWidth(LLVMGetElementType(type));
+    if (count >= width)
+        count = width - 1;
+    return jit::buildAShr(m_builder, value, buildSplat(constInt(LLVMGetElementType(type), count), LLVMGetVectorSize(type)));
+}
+
+LValue Output::buildAddSaturate(LValue lhs, LValue rhs, Signedness signedness)
+{
+    return buildIntrinsic(signedness == Signed ? "llvm.sadd.sat" : "llvm.uadd.sat", lhs, rhs);
+}
+
+LValue Output::buildSubSaturate(LValue lhs, LValue rhs, Signedness signedness)
+{
+    return buildIntrinsic(signedness == Signed ? "llvm.ssub.sat" : "llvm.usub.sat", lhs, rhs);
+}
+
+LValue Output::buildMin(LValue lhs, LValue rhs, Signedness signedness)
+{
+    return buildIntrinsic(signedness == Signed ? "llvm.smin" : "llvm.umin", lhs, rhs);
+}
+
+LValue Output::buildMax(LValue lhs, LValue rhs, Signedness signedness)
+{
+    return buildIntrinsic(signedness == Signed ? "llvm.smax" : "llvm.umax", lhs, rhs);
+}
 }
@@ -1,8 +1,24 @@
 #ifndef OUTPUT_H
 #define OUTPUT_H
+#include <map>
+#include <vector>
 #include "IntrinsicRepository.h"
+#include "LazyFlags.h"
 namespace jit {
 struct CompilerState;
+struct TierUpDesc;
+
+enum Signedness { Unsigned,
+    Signed };
+
+// A result together with the carry (unsigned overflow, or borrow for
+// subtraction) and the signed overflow of the operation, as i1 values.
+struct ArithmeticResult {
+    LValue m_value;
+    LValue m_carry;
+    LValue m_overflow;
+};
+
 class Output {
 public:
     Output(CompilerState& state);
@@ -12,17 +28,161 @@ public:
     LValue constInt32(int);
     LValue constIntPtr(intptr_t);
     LValue constInt64(long long);
+    LValue constInt(LType type, unsigned long long value);
+    LValue constReal(LType type, double value);
+    LType intType(unsigned bits);
     LValue buildStructGEP(LValue structVal, unsigned field);
     LValue buildLoad(LValue toLoad);
     LValue buildStore(LValue val, LValue pointer);
     LValue buildAdd(LValue lhs, LValue rhs);
     LValue buildBr(LBasicBlock bb);
+    LValue buildCondBr(LValue condition, LBasicBlock taken, LBasicBlock notTaken);
     LValue buildRet(LValue ret);
     LValue buildRetVoid(void);
+    // Guest registers: in optimized code each context slot accessed through
+    // these is loaded once, kept in an alloca that mem2reg turns into SSA
+    // values, and written back at every exit if it is stored to anywhere in
+    // the function. Baseline code, which is not optimized, accesses the
+    // context directly. Do not mix them with direct accesses to the same slot
+    // through arg().
     LValue buildLoadArgIndex(int index);
     LValue buildStoreArgIndex(LValue val, int index);
     LValue buildSelect(LValue condition, LValue taken, LValue notTaken);
     LValue buildICmp(LIntPredicate cond, LValue left, LValue right);
+    LValue buildFCmp(LRealPredicate cond, LValue left, LValue right);
+
+    // Integer arithmetic on operands of the same type, all of it in line.
+    // Division by zero and the signed division of the most negative value by
+    // -1 are undefined, as in LLVM: guard them where the guest defines them.
+    LValue buildSub(LValue lhs, LValue rhs);
+    LValue buildMul(LValue lhs, LValue rhs);
+    LValue buildDiv(LValue lhs, LValue rhs, Signedness signedness);
+    LValue buildRem(LValue lhs, LValue rhs, Signedness signedness);
+    LValue buildNeg(LValue value);
+    // The high half of the double width product, as x86 mul and imul leave
+    // in rdx.
+    LValue buildMulHigh(LValue lhs, LValue rhs, Signedness signedness);
+    LValue buildAnd(LValue lhs, LValue rhs);
+    LValue buildOr(LValue lhs, LValue rhs);
+    LValue buildXor(LValue lhs, LValue rhs);
+    LValue buildNot(LValue value);
+    // Shifts and rotates take |count|, of any integer type, modulo the width
+    // of |value|, as guests do for full registers. x86 masks 8 and 16 bit
+    // shift counts to 5 bits instead; widen those first.
+    LValue buildShl(LValue value, LValue count);
+    LValue buildLShr(LValue value, LValue count);
+    LValue buildAShr(LValue value, LValue count);
+    LValue buildRotateLeft(LValue value, LValue count);
+    LValue buildRotateRight(LValue value, LValue count);
+    // With an i1 |carryIn|, adc and sbb.
+    ArithmeticResult buildAddWithFlags(LValue lhs, LValue rhs, LValue carryIn = nullptr);
+    ArithmeticResult buildSubWithFlags(LValue lhs, LValue rhs, LValue borrowIn = nullptr);
+    // The truncated product, with m_carry and m_overflow both set when it
+    // does not fit.
+    ArithmeticResult buildMulWithFlags(LValue lhs, LValue rhs, Signedness signedness);
+    // Counting zeros of 0 gives the width of its type.
+    LValue buildCountLeadingZeros(LValue value);
+    LValue buildCountTrailingZeros(LValue value);
+    LValue buildPopCount(LValue value);
+    LValue buildByteSwap(LValue value);
+
+    // Partial registers. buildInsertBits() replaces the bits of |value| at
+    // |offset| with |field|, whose type gives their count, so that a write
+    // of AH is buildInsertBits(rax, ah, 8).
+    LValue buildTrunc(LValue value, unsigned bits);
+    LValue buildExtend(LValue value, unsigned bits, BitExtension extension);
+    LValue buildExtractBits(LValue value, unsigned offset, unsigned bits);
+    LValue buildInsertBits(LValue value, LValue field, unsigned offset);
+    // Writes |field| into guest register |index| at |offset|, keeping its
+    // other bits the way 8 and 16 bit writes do on x86. A 32 bit write
+    // clearing the upper half is a buildExtend() and buildStoreArgIndex().
+    LValue buildStorePartialArgIndex(LValue field, int index, unsigned offset = 0);
+
+    // Lazy guest flags, see LazyFlags.h. setFlags() records |op| as the last
+    // to set the flags, from |result| of |lhs| and |rhs|, integers of the
+    // same type of at most 64 bits, and an i1 |carryIn| for adc and sbb. The
+    // record goes through guest registers, so that it is only stored to the
+    // context at exits, and records overwritten before are dead code.
+    void setFlags(FlagsOp op, LValue result, LValue lhs, LValue rhs, LValue carryIn = nullptr);
+    // An i1. Derived from the op recorded in the current block when there is
+    // one, and else from the pending flags, whatever op they come from.
+    LValue buildFlag(Flag flag);
+    // The condition a guest branch on |predicate| tests after a compare: the
+    // comparison itself when the last op is a known sub, and the usual
+    // combination of flags otherwise.
+    LValue buildFlagsCondition(LIntPredicate predicate);
+
+    // Guest memory accesses of |type|, any integer, floating point or vector
+    // type, at the guest |address|, an integer as wide as guest addresses.
+    // Through the soft TLB when the platform has one, see SoftTLB.h, and
+    // straight off PlatformDesc::m_guestMemoryBase otherwise. Accesses need
+    // not be aligned.
+    LValue buildGuestLoad(LValue address, LType type);
+    LValue buildGuestStore(LValue value, LValue address);
+
+    // Guest vector registers, see PlatformDesc::m_vectorOffset, cached in
+    // optimized code as the other guest registers are. |type| is any type of
+    // a multiple of 64 bits up to the register size; a 32-bit movd goes
+    // through buildExtractLane() or buildInsertLane() on a 64-bit part.
+    // Narrower loads read the low lanes, and narrower stores keep the upper
+    // ones, as SSE does. VEX encoded ops, which clear them, store a full
+    // width value instead.
+    LValue buildLoadVector(int index, LType type);
+    LValue buildStoreVector(LValue value, int index);
+
+    // Lane-wise, the builders above work on vectors as they do on scalars:
+    // buildAdd(), buildAnd(), buildFMul(), buildFSqrt(), buildSelect() and the
+    // like. These are the ops only vectors have, lowered to vector IR that
+    // is selected for the host CPU: a 32 byte op is one AVX instruction on
+    // a host with AVX, and is split into SSE ones on a host without.
+    LType vectorType(LType element, unsigned count);
+    LValue buildBitCast(LValue value, LType type);
+    LValue buildSplat(LValue scalar, unsigned count);
+    LValue buildExtractLane(LValue vector, unsigned lane);
+    LValue buildInsertLane(LValue vector, LValue scalar, unsigned lane);
+    // Picks lanes of |lhs| followed by those of |rhs|, -1 for any.
+    LValue buildShuffle(LValue lhs, LValue rhs, const int* lanes, unsigned count);
+    // All ones in the lanes where the comparison holds and zero elsewhere,
+    // integers of the lane width, as SSE compares give.
+    LValue buildVectorICmp(LIntPredicate predicate, LValue lhs, LValue rhs);
+    LValue buildVectorFCmp(LRealPredicate predicate, LValue lhs, LValue rhs);
+    // The lanes of |taken| where the top bit of |mask| is set, as blendv.
+    LValue buildVectorBlend(LValue mask, LValue taken, LValue notTaken);
+    // By an immediate. Counts of the lane width or more clear the lanes, or
+    // fill them with their sign for an arithmetic shift, as SSE does.
+    LValue buildVectorShl(LValue value, unsigned count);
+    LValue buildVectorLShr(LValue value, unsigned count);
+    LValue buildVectorAShr(LValue value, unsigned count);
+    // Saturating, and integer min and max; also fine on scalars.
+    LValue buildAddSaturate(LValue lhs, LValue rhs, Signedness signedness);
+    LValue buildSubSaturate(LValue lhs, LValue rhs, Signedness signedness);
+    LValue buildMin(LValue lhs, LValue rhs, Signedness signedness);
+    LValue buildMax(LValue lhs, LValue rhs, Signedness signedness);
+
+    // Floating point on float or double operands of the same type, lowered
+    // to instructions or intrinsics. Code is selected for the host CPU:
+    // without SSE4.1, floor, ceil, trunc and rint become libm calls, as
+    // buildFMulAdd() does without FMA.
+    LValue buildFAdd(LValue lhs, LValue rhs);
+    LValue buildFSub(LValue lhs, LValue rhs);
+    LValue buildFMul(LValue lhs, LValue rhs);
+    LValue buildFDiv(LValue lhs, LValue rhs);
+    LValue buildFNeg(LValue value);
+    LValue buildFAbs(LValue value);
+    LValue buildFSqrt(LValue value);
+    LValue buildFFloor(LValue value);
+    LValue buildFCeil(LValue value);
+    LValue buildFTrunc(LValue value);
+    // Rounds in the current rounding mode.
+    LValue buildFRint(LValue value);
+    // IEEE minNum and maxNum, which return the other operand for a NaN,
+    // unlike x86 minsd and maxsd; build those from buildFCmp() and
+    // buildSelect().
+    LValue buildFMin(LValue lhs, LValue rhs);
+    LValue buildFMax(LValue lhs, LValue rhs);
+    // lhs * rhs + addend, rounded once.
+    LValue buildFMulAdd(LValue lhs, LValue rhs, LValue addend);
+    LValue buildFCopySign(LValue magnitude, LValue sign);
 
     inline LValue buildCall(LValue function, const LValue* args, unsigned numArgs)
     {
@@ -54,6 +214,28 @@ public:
     void buildDirectPatch(uintptr_t where);
     void buildIndirectPatch(LValue where);
     void buildAssistPatch(LValue where);
+    // Calls |helper|(context, argument) in line and goes on with its result,
+    // rather than leaving for the dispatcher. The call goes through a stub
+    // made at link time that only keeps the registers live across it, as
+    // told by the stack map. Guest registers are in the context for the
+    // duration of the call, and may be changed there.
+    LValue buildAssistCall(uintptr_t helper, LValue argument);
+    // Traces: several guest blocks compiled as one function along their hot
+    // path. When |condition| holds, leaves for |target| through a Direct
+    // patch point of its own, weighted as cold; otherwise goes on in a new
+    // block, where the builder is left positioned.
+    void buildSideExit(LValue condition, uintptr_t target);
+    // Regions: guest blocks compiled as one function with their own control
+    // flow. Starts the code of the guest block at |pc|, falling through from
+    // the current block if it is not terminated.
+    void buildRegionBlock(uintptr_t pc);
+    // Goes to the guest block at |target|. Blocks started in this region,
+    // before or after the branch, are reached by an LLVM branch, so a
+    // back-edge makes a real loop whose registers mem2reg turns into phis.
+    // Targets never started leave through a Direct patch point each. In code
+    // that tiers up, back-edges count towards it like entries do.
+    void buildRegionBranch(uintptr_t target);
+    void buildRegionCondBranch(LValue condition, uintptr_t taken, uintptr_t notTaken);
 
     inline IntrinsicRepository& repo() { return m_repo; }
     inline LType argType() const { return m_argType; }
@@ -62,7 +244,44 @@ public:
 
 private:
     void buildGetArg();
-    void buildPatchCommon(LValue where, const PatchDesc& desc, size_t patchSize);
+    // Counts an entry, and leaves for the guest |pc| once the optimized code
+    // is ready.
+    void buildTierUpCheck(const TierUpDesc& desc, uintptr_t pc);
+    // Leaves for the guest |pc| when the code cache asks the guest thread
+    // out of translated code.
+    void buildExitRequestCheck(uintptr_t pc);
+    LValue constPointer(const void* pointer, LType type);
+    void setUnlikely(LValue branch);
+    LValue buildIntrinsic(const char* name, LValue value);
+    LValue buildIntrinsic(const char* name, LValue lhs, LValue rhs);
+    LValue castCount(LValue count, LType type);
+    LValue buildFlagFromPending(Flag flag);
+    int flagsSlot(unsigned word) const;
+    // |target|, if any, is passed to the patch point in a register.
+    // |writeback| is false when dirty registers were already written back on
+    // the way to this exit.
+    void buildPatchCommon(LValue where, const PatchDesc& desc, size_t patchSize, LValue target = nullptr, bool writeback = true);
+    LValue buildContextSlot(LBuilder builder, int index);
+    LValue registerSlot(int index);
+    // What the context slot |index| holds, for TBAA, see CommonValues.
+    LValue contextTag(size_t index);
+    LValue setAliasTag(LValue access, LValue tag);
+    LValue buildContextLoad(LBuilder builder, int index);
+    LValue buildContextStore(LBuilder builder, LValue value, int index);
+    LValue buildVectorContextSlot(LBuilder builder, int index);
+    LValue buildVectorContextLoad(LBuilder builder, int index);
+    LValue buildVectorContextStore(LBuilder builder, LValue value, int index);
+    LValue vectorRegister(int index);
+    LValue buildLoadVectorRegister(int index);
+    LValue vectorPart(LValue vector, unsigned from, unsigned count);
+    LValue buildHostAddress(LValue address, unsigned size, bool store);
+    void buildRegisterWriteback();
+    // At |m_registerBuilder|'s position.
+    void buildRegisterStores();
+    void buildRegisterReloads();
+    LBasicBlock regionBlock(uintptr_t pc);
+    LBasicBlock regionTarget(uintptr_t pc);
+    void buildRegionExits();
 
     CompilerState& m_state;
     IntrinsicRepository m_repo;
@@ -71,6 +290,35 @@ private:
     LBasicBlock m_prologue;
     LValue m_arg;
     uint32_t m_stackMapsId;
+    uint64_t m_buildStart;
+    // Emits register cache code outside of the current insertion point.
+    LBuilder m_registerBuilder;
+    std::vector<LValue> m_registers;
+    std::vector<bool> m_dirty;
+    // Likewise for vector registers, as <n x i64>.
+    LType m_vectorType;
+    std::vector<LValue> m_vectorRegisters;
+    std::vector<bool> m_vectorDirty;
+    // Where every exit writes back dirty registers, right before this.
+    std::vector<LValue> m_exits;
+    // In line assists, around which registers are written back and reloaded.
+    std::vector<LValue> m_assists;
+    struct RegionBlock {
+        LBasicBlock m_block;
+        bool m_started;
+    };
+    // Ordered, so that exits are numbered the same from build to build.
+    std::map<uintptr_t, RegionBlock> m_regionBlocks;
+    // The last setFlags() and the block it was built in.
+    struct KnownFlags {
+        LBasicBlock m_block;
+        FlagsOp m_op;
+        LValue m_result;
+        LValue m_lhs;
+        LValue m_rhs;
+        LValue m_carryIn;
+    };
+    KnownFlags m_flags;
 };
 }
 #endif /* OUTPUT_H */
@@ -0,0 +1,102 @@
+#include "log.h"
+#include "PassPipeline.h"
+
+namespace jit {
+
+static void addO2Passes(LLVMPassManagerRef passManager)
+{
+    LLVMPassManagerBuilderRef passBuilder = LLVMPassManagerBuilderCreate();
+    LLVMPassManagerBuilderSetOptLevel(passBuilder, 2);
+    LLVMPassManagerBuilderUseInlinerWithThreshold(passBuilder, 275);
+    LLVMPassManagerBuilderSetSizeLevel(passBuilder, 0);
+    LLVMPassManagerBuilderPopulateModulePassManager(passBuilder, passManager);
+    LLVMPassManagerBuilderDispose(passBuilder);
+}
+
+struct PassEntry {
+    const char* m_name;
+    void (*m_add)(LLVMPassManagerRef);
+};
+
+// Names as in opt. Loop idiom recognition is left out: the memset and
+// memcpy calls it introduces cannot be resolved from translated code.
+static const PassEntry passEntries[] = {
+    { "lower-expect", LLVMAddLowerExpectIntrinsicPass },
+    { "sroa", LLVMAddScalarReplAggregatesPass },
+    { "mem2reg", LLVMAddPromoteMemoryToRegisterPass },
+    { "early-cse", LLVMAddEarlyCSEPass },
+    { "instcombine", LLVMAddInstructionCombiningPass },
+    { "reassociate", LLVMAddReassociatePass },
+    { "sccp", LLVMAddSCCPPass },
+    { "gvn", LLVMAddGVNPass },
+    { "newgvn", LLVMAddNewGVNPass },
+    { "dse", LLVMAddDeadStoreEliminationPass },
+    { "adce", LLVMAddAggressiveDCEPass },
+    { "simplifycfg", LLVMAddCFGSimplificationPass },
+    { "jump-threading", LLVMAddJumpThreadingPass },
+    { "correlated-propagation", LLVMAddCorrelatedValuePropagationPass },
+    { "loop-rotate", LLVMAddLoopRotatePass },
+    { "licm", LLVMAddLICMPass },
+    { "indvars", LLVMAddIndVarSimplifyPass },
+    { "loop-deletion", LLVMAddLoopDeletionPass },
+    { "loop-unroll", LLVMAddLoopUnrollPass },
+    { "loop-vectorize", LLVMAddLoopVectorizePass },
+    { "slp-vectorizer", LLVMAddSLPVectorizePass },
+    { "o2", addO2Passes },
+};
+
+PassPipeline::PassPipeline()
+    : m_loopPasses("loop-rotate,licm,indvars,loop-deletion,loop-unroll,loop-vectorize,instcombine,simplifycfg")
+    , m_timePasses(false)
+{
+    // The baseline tier only has to be correct, and soon.
+    m_passes[static_cast<unsigned>(Tier::Optimized)] = "lower-expect,simplifycfg,sroa,early-cse,instcombine,simplifycfg,loops,gvn,dse,instcombine,simplifycfg";
+}
+
+static void split(const std::string& list, std::vector<std::string>& names)
+{
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        if (end > start)
+            names.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+std::vector<std::string> PassPipeline::passes(Tier tier, bool loops) const
+{
+    std::vector<std::string> names;
+    std::vector<std::string> listed;
+    split(m_passes[static_cast<unsigned>(tier)], listed);
+    for (auto& name : listed) {
+        if (name != "loops")
+            names.push_back(name);
+        else if (loops)
+            split(m_loopPasses, names);
+    }
+    return names;
+}
+
+bool PassPipeline::addPass(LLVMPassManagerRef passManager, const std::string& name)
+{
+    for (auto& entry : passEntries) {
+        if (name == entry.m_name) {
+            entry.m_add(passManager);
+            return true;
+        }
+    }
+    LOGE("Unknown pass %s.", name.c_str());
+    return false;
+}
+
+std::vector<std::string> PassPipeline::passNames()
+{
+    std::vector<std::string> names;
+    for (auto& entry : passEntries)
+        names.push_back(entry.m_name);
+    return names;
+}
+}
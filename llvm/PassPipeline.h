@@ -0,0 +1,35 @@
+#ifndef PASSPIPELINE_H
+#define PASSPIPELINE_H
+#include <string>
+#include <vector>
+#include "LLVMHeaders.h"
+#include "CompileStats.h"
+
+namespace jit {
+
+// The passes each tier runs, as comma separated names from
+// PassPipeline::passNames(). Translations are a function or a few with
+// intrinsic declarations only, so the default optimized pipeline keeps to
+// the scalar cleanups that pay off on them and leaves out the inliner and
+// the interprocedural passes of O2. Two names are special:
+//  - "loops" stands for m_loopPasses, and is only run on modules built with
+//    loops (CompilerState::m_hasLoops), that is region mode.
+//  - "o2" is the whole PassManagerBuilder O2 pipeline, for comparison.
+struct PassPipeline {
+    PassPipeline();
+
+    std::string m_passes[tierCount];
+    std::string m_loopPasses;
+    // Runs every pass through a pass manager of its own and records its
+    // time in CompileStats, at some cost in compile time.
+    bool m_timePasses;
+
+    // The passes |tier| runs on a module, with "loops" expanded or dropped.
+    std::vector<std::string> passes(Tier tier, bool loops) const;
+    // Adds the pass |name| to |passManager|. Returns false, leaving it
+    // alone, if there is no such pass.
+    static bool addPass(LLVMPassManagerRef passManager, const std::string& name);
+    static std::vector<std::string> passNames();
+};
+}
+#endif /* PASSPIPELINE_H */
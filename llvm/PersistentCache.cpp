@@ -0,0 +1,295 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+#include "CodeCache.h"
+#include "CompilerState.h"
+#include "Link.h"
+#include "PersistentCache.h"
+
+namespace jit {
+
+static const char fileMagic[8] = { 'j', 'i', 't', 'c', 'a', 'c', 'h', '1' };
+
+struct PersistentCache::FileHeader {
+    char m_magic[8];
+    uint64_t m_descHash;
+    uint64_t m_count;
+};
+
+// Followed by m_siteCount FileSite and m_codeSize bytes of code, starting at
+// the prologue and padded to 8 bytes.
+struct PersistentCache::FileRecord {
+    uint64_t m_pc;
+    uint64_t m_irHash;
+    uint32_t m_codeSize;
+    uint32_t m_alignment;
+    uint32_t m_siteCount;
+    uint32_t m_reserved;
+};
+
+struct PersistentCache::FileSite {
+    uint32_t m_offset;
+    int32_t m_reg;
+    uint32_t m_type;
+    uint32_t m_reserved;
+    uint64_t m_target;
+};
+
+static inline uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    // FNV-1a.
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static const uint64_t hashSeed = 0xcbf29ce484222325ULL;
+
+static inline size_t round_up(size_t s, size_t alignment)
+{
+    return (s + alignment - 1) & ~(alignment - 1);
+}
+
+static uint64_t hashDesc(const PlatformDesc& desc)
+{
+    // Only the layout, and where guest memory is: the callbacks and m_opaque
+    // differ from run to run.
+    const size_t layout[] = {
+        desc.m_contextSize,
+        desc.m_pcFieldOffset,
+        desc.m_prologueSize,
+        desc.m_directSize,
+        desc.m_indirectSize,
+        desc.m_assistSize,
+        desc.m_assistCallSize,
+        desc.m_indirectCacheOffset,
+        desc.m_indirectCacheEntries,
+        desc.m_flagsOffset,
+        desc.m_vectorOffset,
+        desc.m_vectorCount,
+        desc.m_vectorSize,
+        desc.m_guestMemoryBase,
+        desc.m_tlbOffset,
+        desc.m_tlbEntries,
+        desc.m_tlbPageShift,
+        desc.m_exitRequestOffset,
+    };
+    return hashBytes(hashSeed, layout, sizeof(layout));
+}
+
+PersistentCache::PersistentCache(const char* path, const PlatformDesc& desc)
+    : m_path(path)
+    , m_descHash(hashDesc(desc))
+    , m_desc(desc)
+    , m_mapped(nullptr)
+    , m_mappedSize(0)
+{
+    map();
+}
+
+PersistentCache::~PersistentCache()
+{
+    if (m_mapped)
+        munmap(m_mapped, m_mappedSize);
+}
+
+size_t PersistentCache::recordSize(const FileRecord* record)
+{
+    return sizeof(FileRecord) + record->m_siteCount * sizeof(FileSite) + round_up(record->m_codeSize, 8);
+}
+
+void PersistentCache::map()
+{
+    int fd = open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+        close(fd);
+        return;
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+        return;
+    m_mapped = static_cast<uint8_t*>(mapped);
+    m_mappedSize = st.st_size;
+
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(m_mapped);
+    if (memcmp(header->m_magic, fileMagic, sizeof(fileMagic)) || header->m_descHash != m_descHash) {
+        LOGD("%s does not match this platform, ignoring it.", m_path.c_str());
+        return;
+    }
+    size_t offset = sizeof(FileHeader);
+    for (uint64_t i = 0; i < header->m_count; ++i) {
+        if (offset + sizeof(FileRecord) > m_mappedSize)
+            break;
+        const FileRecord* record = reinterpret_cast<const FileRecord*>(m_mapped + offset);
+        if (offset + recordSize(record) > m_mappedSize)
+            break;
+        m_index[record->m_pc] = record;
+        offset += recordSize(record);
+    }
+    LOGD("loaded %lu translations from %s.", static_cast<unsigned long>(m_index.size()), m_path.c_str());
+}
+
+// Intrinsics the backend may lower to a call into libm, libgcc or libc,
+// whose address is this process's, depending on the CPU or the operands.
+static const char* const libcallIntrinsics[] = {
+    "llvm.floor.", "llvm.ceil.", "llvm.trunc.", "llvm.rint.", "llvm.nearbyint.",
+    "llvm.round.", "llvm.roundeven.", "llvm.fma.", "llvm.pow.", "llvm.powi.",
+    "llvm.exp.", "llvm.exp2.", "llvm.log.", "llvm.log2.", "llvm.log10.",
+    "llvm.sin.", "llvm.cos.", "llvm.memcpy.", "llvm.memmove.", "llvm.memset.",
+};
+
+static bool isLibcallIntrinsic(LLVMValueRef intrinsic)
+{
+    size_t length;
+    const char* name = LLVMGetValueName2(intrinsic, &length);
+    for (const char* prefix : libcallIntrinsics) {
+        if (!strncmp(name, prefix, strlen(prefix)))
+            return true;
+    }
+    return false;
+}
+
+// So may these instructions.
+static bool mayLowerToLibcall(LLVMValueRef instruction)
+{
+    switch (LLVMGetInstructionOpcode(instruction)) {
+    case LLVMFRem:
+        return true;
+    case LLVMUDiv:
+    case LLVMSDiv:
+    case LLVMURem:
+    case LLVMSRem: {
+        LLVMTypeRef type = LLVMTypeOf(instruction);
+        return LLVMGetTypeKind(type) == LLVMIntegerTypeKind && LLVMGetIntTypeWidth(type) > 64;
+    }
+    default:
+        return false;
+    }
+}
+
+bool PersistentCache::portable(LLVMModuleRef module)
+{
+    if (LLVMGetFirstGlobal(module))
+        return false;
+    unsigned definitions = 0;
+    for (LLVMValueRef function = LLVMGetFirstFunction(module); function; function = LLVMGetNextFunction(function)) {
+        if (!LLVMIsDeclaration(function)) {
+            definitions++;
+            for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block; block = LLVMGetNextBasicBlock(block)) {
+                for (LLVMValueRef instruction = LLVMGetFirstInstruction(block); instruction; instruction = LLVMGetNextInstruction(instruction)) {
+                    if (mayLowerToLibcall(instruction))
+                        return false;
+                }
+            }
+        } else if (!LLVMGetIntrinsicID(function) || isLibcallIntrinsic(function))
+            return false;
+    }
+    return definitions == 1;
+}
+
+uint64_t PersistentCache::hashModule(LLVMModuleRef module)
+{
+    char* text = LLVMPrintModuleToString(module);
+    uint64_t hash = hashBytes(hashSeed, text, strlen(text));
+    LLVMDisposeMessage(text);
+    return hash;
+}
+
+void* PersistentCache::load(uintptr_t pc, uint64_t irHash, CodeCache& codeCache, BlockChainer* chainer)
+{
+    const FileRecord* record;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        auto found = m_index.find(pc);
+        if (found == m_index.end() || found->second->m_irHash != irHash)
+            return nullptr;
+        record = found->second;
+    }
+    uint8_t* data = codeCache.allocate(record->m_codeSize, record->m_alignment, m_desc.m_prologueSize);
+    if (!data)
+        return nullptr;
+    const FileSite* fileSites = reinterpret_cast<const FileSite*>(record + 1);
+    memcpy(data, fileSites + record->m_siteCount, record->m_codeSize);
+    PatchSiteList sites;
+    sites.reserve(record->m_siteCount);
+    for (uint32_t i = 0; i < record->m_siteCount; ++i) {
+        const FileSite& fileSite = fileSites[i];
+        PatchSite site = { 0, fileSite.m_offset, fileSite.m_reg, { static_cast<PatchType>(fileSite.m_type), static_cast<uintptr_t>(fileSite.m_target) }, {} };
+        sites.push_back(site);
+    }
+    void* entryPoint = codeCache.executableAddress(data);
+    linkTranslation(m_desc, codeCache, chainer, entryPoint, record->m_codeSize, sites.data(), sites.size());
+    return entryPoint;
+}
+
+void PersistentCache::record(const CompilerState& state, uintptr_t pc, uint64_t irHash)
+{
+    if (state.m_tier != Tier::Optimized || state.m_tierUp)
+        return;
+    if (state.m_entryPoints.size() != 1 || state.m_codeSectionList.size() != 1)
+        return;
+    // Anything but unwind info could be referenced from the code.
+    for (auto& name : state.m_dataSectionNames) {
+        if (name != ".eh_frame" && name != ".llvm_stackmaps")
+            return;
+    }
+    // Assist helpers are addresses in this process.
+    for (auto& site : state.m_patchSites) {
+        if (site.m_desc.m_type == PatchType::AssistCall)
+            return;
+    }
+    const CodeSection& code = state.m_codeSectionList.front();
+    FileRecord header = { pc, irHash, static_cast<uint32_t>(code.m_size), code.m_alignment, static_cast<uint32_t>(state.m_patchSites.size()), 0 };
+    std::vector<uint8_t> buffer(recordSize(&header));
+    memcpy(buffer.data(), &header, sizeof(header));
+    FileSite* fileSites = reinterpret_cast<FileSite*>(buffer.data() + sizeof(header));
+    for (auto& site : state.m_patchSites) {
+        FileSite fileSite = { site.m_offset, site.m_reg, static_cast<uint32_t>(site.m_desc.m_type), 0, site.m_desc.m_target };
+        *fileSites++ = fileSite;
+    }
+    // The patch sites are rewritten when loading, so it does not matter
+    // whether they have been chained in the meantime.
+    memcpy(fileSites, code.m_data, code.m_size);
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_recorded.push_back(std::move(buffer));
+    m_index[pc] = reinterpret_cast<const FileRecord*>(m_recorded.back().data());
+}
+
+bool PersistentCache::save()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::string temporary = m_path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        LOGE("Could not write %s.", temporary.c_str());
+        return false;
+    }
+    FileHeader header;
+    memcpy(header.m_magic, fileMagic, sizeof(fileMagic));
+    header.m_descHash = m_descHash;
+    header.m_count = m_index.size();
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (auto& entry : m_index)
+        ok = ok && fwrite(entry.second, recordSize(entry.second), 1, file) == 1;
+    ok = !fclose(file) && ok;
+    // Replacing the file leaves the current mapping intact.
+    if (!ok || rename(temporary.c_str(), m_path.c_str())) {
+        LOGE("Could not save translations to %s.", m_path.c_str());
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+}
@@ -0,0 +1,71 @@
+#ifndef PERSISTENTCACHE_H
+#define PERSISTENTCACHE_H
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "LLVMHeaders.h"
+#include "PlatformDesc.h"
+
+namespace jit {
+struct CompilerState;
+class CodeCache;
+class BlockChainer;
+
+// Translations kept on disk across runs. Each one is keyed by its guest pc and
+// a hash of its IR; the file as a whole is tied to a hash of the PlatformDesc
+// layout. The code is stored as linked, together with its patch sites, and
+// loading copies it into the code cache and patches every site again, which
+// rewrites the absolute addresses the platform embeds there for this process.
+//
+// Only translations whose code is position independent apart from the patch
+// sites are kept: optimized, single function modules without globals, calls
+// to anything but intrinsics or in line assists, and no data sections other
+// than unwind info.
+class PersistentCache {
+public:
+    // Maps |path| if it exists and matches |desc|.
+    PersistentCache(const char* path, const PlatformDesc& desc);
+    ~PersistentCache();
+    PersistentCache(const PersistentCache&) = delete;
+    const PersistentCache& operator=(const PersistentCache&) = delete;
+
+    // Whether code built from |module| could be stored: it must not call out
+    // of the translation, not even to libm. Call before compile().
+    static bool portable(LLVMModuleRef module);
+    static uint64_t hashModule(LLVMModuleRef module);
+
+    // Returns the executable entry of the stored translation of |pc|, copied
+    // into |codeCache| and linked, or nullptr if there is none for |irHash|.
+    // The copy stays pinned until the caller publishes it and releases it,
+    // see CodeCache::release().
+    void* load(uintptr_t pc, uint64_t irHash, CodeCache& codeCache, BlockChainer* chainer);
+    // Keeps the translation of |pc| just linked in |state| for save().
+    void record(const CompilerState& state, uintptr_t pc, uint64_t irHash);
+    // Writes the loaded and the recorded translations to the file.
+    bool save();
+
+    inline size_t size() const { return m_index.size(); }
+
+private:
+    struct FileHeader;
+    struct FileRecord;
+    struct FileSite;
+
+    static size_t recordSize(const FileRecord* record);
+    void map();
+
+    std::string m_path;
+    uint64_t m_descHash;
+    const PlatformDesc m_desc;
+    uint8_t* m_mapped;
+    size_t m_mappedSize;
+    std::unordered_map<uintptr_t, const FileRecord*> m_index;
+    std::list<std::vector<uint8_t>> m_recorded;
+    std::mutex m_lock;
+};
+}
+#endif /* PERSISTENTCACHE_H */
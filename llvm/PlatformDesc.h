@@ -1,5 +1,31 @@
 #ifndef PLATFORMDESC_H
 #define PLATFORMDESC_H
+#include <stddef.h>
+#include <stdint.h>
+
+// An assist called in line, see Output::buildAssistCall(). Registers are
+// numbered as in Registers.h, -1 meaning none.
+struct AssistCallDesc {
+    // uint64_t helper(void* context, uint64_t argument)
+    void* m_helper;
+    // Registers live across the call, general purpose ones in the low 32
+    // bits, floating point ones from bit 32 up. The stub has to preserve
+    // those the helper may clobber, and only those.
+    uint64_t m_liveRegisters;
+    // Bytes of the widest floating point register live across the call, as
+    // the stack maps give it: 16 for an xmm, 32 when the upper half of a ymm
+    // is live too.
+    unsigned m_floatLiveSize;
+    int m_context;
+    // When there is no register, the argument is the constant m_argumentValue.
+    int m_argument;
+    int64_t m_argumentValue;
+    int m_result;
+};
+
+// Guest memory accesses are 1 << n bytes wide, n below tlbAccessSizes: from
+// a byte up to a 32 byte vector.
+static const unsigned tlbAccessSizes = 6;
 
 struct PlatformDesc {
     size_t m_contextSize;
@@ -8,11 +34,62 @@ struct PlatformDesc {
     size_t m_directSize;
     size_t m_indirectSize;
     size_t m_assistSize;
+    // The patch area of an in line assist, and the most an assist stub takes.
+    size_t m_assistCallSize;
+    size_t m_assistStubSize;
+    // Inline indirect branch cache in the context, m_indirectCacheEntries is
+    // a power of two no less than 2, or 0 to always exit to the dispatcher.
+    size_t m_indirectCacheOffset;
+    size_t m_indirectCacheEntries;
+    // Pending guest flags in the context, see LazyFlags.h, or 0 when the
+    // guest has no flags.
+    size_t m_flagsOffset;
+    // m_vectorCount guest vector registers of m_vectorSize bytes, 16 or 32,
+    // in the context from m_vectorOffset. The context, and the offset, are
+    // then aligned to m_vectorSize.
+    size_t m_vectorOffset;
+    size_t m_vectorCount;
+    size_t m_vectorSize;
+    // Guest memory, see Output::buildGuestLoad(): a soft TLB of
+    // m_tlbEntries, a power of two, in the context at m_tlbOffset over pages
+    // of 1 << m_tlbPageShift bytes, see SoftTLB.h. With m_tlbEntries 0,
+    // guest memory is mapped as is from m_guestMemoryBase in the host,
+    // guarded by host page protection.
+    uintptr_t m_guestMemoryBase;
+    size_t m_tlbOffset;
+    size_t m_tlbEntries;
+    size_t m_tlbPageShift;
+    // The soft TLB misses, in line assists taking the guest address, one per
+    // access size: m_tlbLoadMiss[n] is called for loads of 1 << n bytes.
+    // They fill the entry of the page, or raise the guest fault, and return
+    // the host address to access. An access crossing into the next page
+    // always misses and the helper has to handle it: all of its bytes must
+    // be accessible from the returned address, such as where both pages are
+    // contiguous in the host or, for a load, in a copy of them.
+    void* m_tlbLoadMiss[tlbAccessSizes];
+    void* m_tlbStoreMiss[tlbAccessSizes];
+    // A word in the context that translations poll at their entry and on
+    // loop back-edges, leaving for the dispatcher when it is nonzero, see
+    // CodeCache::setExitRequest(). 0 when the guest thread is never asked
+    // out of translated code.
+    size_t m_exitRequestOffset;
     void* m_opaque;
     void (*m_patchPrologue)(void* opaque, uint8_t* start, uint8_t* end);
     void (*m_patchDirect)(void* opaque, uint8_t* toFill);
     void (*m_patchIndirect)(void* opaque, uint8_t* toFill);
     void (*m_patchAssist)(void* opaque, uint8_t* toFill);
+    // Rewrites a direct patch area to jump to |target|, or back to the
+    // dispatcher when |target| is null. |executable| is where it runs from.
+    void (*m_chainDirect)(void* opaque, uint8_t* toFill, uint8_t* executable, void* target);
+    // Fills an indirect patch area that jumps to the host address in |reg|.
+    void (*m_patchIndirectJump)(void* opaque, uint8_t* toFill, int reg);
+    // Writes the stub of an in line assist to |buffer|, at most
+    // m_assistStubSize bytes of position independent code, and returns its
+    // size. The stub is called from the patch area and returns there.
+    size_t (*m_emitAssistStub)(void* opaque, uint8_t* buffer, const AssistCallDesc& desc);
+    // Fills the patch area of an in line assist with a call to the executable
+    // |stub|. |executable| is where the patch area runs from.
+    void (*m_patchAssistCall)(void* opaque, uint8_t* toFill, uint8_t* executable, uint8_t* stub);
 };
 
 #endif /* PLATFORMDESC_H */
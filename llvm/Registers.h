@@ -7,6 +7,7 @@ enum AMD64 {
     RDX = 2,
     RSP = 4,
     RBP = 5,
+    R10 = 10,
     R11 = 11,
     RSI = 6,
     RDI = 7,
@@ -0,0 +1,53 @@
+#ifndef SOFTTLB_H
+#define SOFTTLB_H
+#include <string.h>
+#include <stdint.h>
+#include "PlatformDesc.h"
+
+namespace jit {
+
+// Direct mapped (guest page -> host) table living in the context at
+// PlatformDesc::m_tlbOffset. Guest loads and stores compare the tag of their
+// page inline and add the entry's addend to the guest address on a hit; on a
+// miss they call the platform's miss helper for their size in line, which
+// fills the entry. Accesses crossing a page always miss, and are left to the
+// helper, see PlatformDesc::m_tlbLoadMiss.
+struct SoftTLBEntry {
+    // Guest page addresses, or softTLBInvalidTag when loads, or stores, of
+    // the page have to take the miss helper.
+    uint64_t m_readTag;
+    uint64_t m_writeTag;
+    // Host address minus guest address of the page.
+    uintptr_t m_addend;
+    uintptr_t m_unused;
+};
+
+// Never the address of a page, whatever its size.
+static const uint64_t softTLBInvalidTag = ~static_cast<uint64_t>(0);
+
+static inline size_t softTLBIndex(uint64_t address, const PlatformDesc& desc)
+{
+    return static_cast<size_t>(address >> desc.m_tlbPageShift) & (desc.m_tlbEntries - 1);
+}
+
+static inline SoftTLBEntry* softTLB(void* context, const PlatformDesc& desc)
+{
+    return reinterpret_cast<SoftTLBEntry*>(static_cast<uint8_t*>(context) + desc.m_tlbOffset);
+}
+
+// Maps the guest page of |address| at |host|, the host address of the page.
+static inline void fillSoftTLB(void* context, const PlatformDesc& desc, uint64_t address, void* host, bool writable)
+{
+    uint64_t page = address & ~((static_cast<uint64_t>(1) << desc.m_tlbPageShift) - 1);
+    SoftTLBEntry& entry = softTLB(context, desc)[softTLBIndex(address, desc)];
+    entry.m_readTag = page;
+    entry.m_writeTag = writable ? page : softTLBInvalidTag;
+    entry.m_addend = reinterpret_cast<uintptr_t>(host) - page;
+}
+
+static inline void flushSoftTLB(void* context, const PlatformDesc& desc)
+{
+    memset(softTLB(context, desc), 0xff, desc.m_tlbEntries * sizeof(SoftTLBEntry));
+}
+}
+#endif /* SOFTTLB_H */
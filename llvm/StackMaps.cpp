@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <string.h>
 #include "StackMaps.h"
 namespace jit {
 
@@ -54,11 +56,19 @@ void StackMaps::StackSize::parse(StackMaps::ParseContext& context)
     case 0:
         functionOffset = context.view->read<uint32_t>(context.offset, true);
         size = context.view->read<uint32_t>(context.offset, true);
+        recordCount = 0;
+        break;
+
+    case 1:
+        functionOffset = context.view->read<uint64_t>(context.offset, true);
+        size = context.view->read<uint64_t>(context.offset, true);
+        recordCount = 0;
         break;
 
     default:
         functionOffset = context.view->read<uint64_t>(context.offset, true);
         size = context.view->read<uint64_t>(context.offset, true);
+        recordCount = context.view->read<uint64_t>(context.offset, true);
         break;
     }
 }
@@ -66,8 +76,15 @@ void StackMaps::StackSize::parse(StackMaps::ParseContext& context)
 void StackMaps::Location::parse(StackMaps::ParseContext& context)
 {
     kind = static_cast<Kind>(context.view->read<uint8_t>(context.offset, true));
-    size = context.view->read<uint8_t>(context.offset, true);
-    dwarfReg = DWARFRegister(context.view->read<uint16_t>(context.offset, true));
+    if (context.version >= 2) {
+        context.view->read<uint8_t>(context.offset, true); // reserved
+        size = context.view->read<uint16_t>(context.offset, true);
+        dwarfReg = DWARFRegister(context.view->read<uint16_t>(context.offset, true));
+        context.view->read<uint16_t>(context.offset, true); // reserved
+    } else {
+        size = context.view->read<uint8_t>(context.offset, true);
+        dwarfReg = DWARFRegister(context.view->read<uint16_t>(context.offset, true));
+    }
     this->offset = context.view->read<int32_t>(context.offset, true);
 }
 
@@ -93,6 +110,11 @@ bool StackMaps::Record::parse(StackMaps::ParseContext& context)
     while (length--)
         locations.push_back(readObject<Location>(context));
 
+    if (context.version >= 2 && (context.offset & 7)) {
+        assert(!(context.offset & 3));
+        context.view->read<uint32_t>(context.offset, true); // padding
+    }
+
     if (context.version >= 1)
         context.view->read<uint16_t>(context.offset, true); // padding
 
@@ -115,7 +137,8 @@ RegisterSet StackMaps::Record::locationSet() const
     RegisterSet result;
     for (unsigned i = locations.size(); i--;) {
         Reg reg = locations[i].dwarfReg.reg();
-        result.set(reg.val() << (reg.isFloat() ? 32 : 0));
+        if (reg.val() != Reg::invalid())
+            result.set(reg.val() + (reg.isFloat() ? 32 : 0));
     }
     return result;
 }
@@ -129,16 +152,15 @@ RegisterSet StackMaps::Record::liveOutsSet() const
         // FIXME: Either assert that size is not greater than sizeof(pointer), or actually
         // save the high bits of registers.
         // https://bugs.webkit.org/show_bug.cgi?id=130885
-        result.set(reg.val() << (reg.isFloat() ? 32 : 0));
+        if (reg.val() != Reg::invalid())
+            result.set(reg.val() + (reg.isFloat() ? 32 : 0));
     }
     return result;
 }
 
 static void merge(RegisterSet& dst, const RegisterSet& input)
 {
-    for (int i = 0; i < input.size(); ++i) {
-        dst.set(i, dst.test(i) ^ input.test(i) ^ dst.test(i));
-    }
+    dst |= input;
 }
 
 RegisterSet StackMaps::Record::usedRegisterSet() const
@@ -204,4 +226,144 @@ unsigned StackMaps::stackSize() const
 
     return stackSizes[0].size;
 }
+
+template <typename T>
+static inline T load(const uint8_t* p)
+{
+    T result;
+    memcpy(&result, p, sizeof(T));
+    return result;
+}
+
+static inline size_t alignTo8(size_t offset)
+{
+    return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+CompactStackMaps::CompactStackMaps()
+    : m_section(nullptr)
+    , m_version(0)
+    , m_functionCount(0)
+{
+}
+
+bool CompactStackMaps::parse(const uint8_t* section)
+{
+    m_section = section;
+    m_version = section[0];
+    assert(m_version >= 1);
+    m_functionCount = load<uint32_t>(section + 4);
+    uint32_t constantCount = load<uint32_t>(section + 8);
+    uint32_t recordCount = load<uint32_t>(section + 12);
+    m_index.clear();
+    m_index.reserve(recordCount);
+
+    size_t offset = 16 + m_functionCount * functionRecordSize() + constantCount * sizeof(int64_t);
+    unsigned function = 0;
+    uint64_t functionRecordsLeft = m_version >= 2 && m_functionCount ? load<uint64_t>(section + 16 + 16) : recordCount;
+    for (uint32_t i = 0; i < recordCount; ++i) {
+        while (!functionRecordsLeft && function + 1 < m_functionCount) {
+            ++function;
+            functionRecordsLeft = load<uint64_t>(section + 16 + function * functionRecordSize() + 16);
+        }
+        functionRecordsLeft--;
+        int64_t id = load<int64_t>(section + offset);
+        assert(static_cast<int32_t>(id) == id);
+        if (static_cast<int32_t>(id) < 0)
+            return false;
+        Record::Entry entry = { static_cast<uint32_t>(id), load<uint32_t>(section + offset + 8), static_cast<uint32_t>(offset), function };
+        m_index.push_back(entry);
+
+        unsigned locationCount = load<uint16_t>(section + offset + 14);
+        offset += 16 + locationCount * locationSize();
+        if (m_version >= 2)
+            offset = alignTo8(offset);
+        unsigned liveOutCount = load<uint16_t>(section + offset + 2);
+        offset = alignTo8(offset + 4 + liveOutCount * 4);
+    }
+    // Ids are handed out in build order, so this is usually sorted already.
+    std::stable_sort(m_index.begin(), m_index.end(),
+        [](const Record::Entry& a, const Record::Entry& b) { return a.m_id < b.m_id; });
+    return true;
+}
+
+uint64_t CompactStackMaps::functionAddress(unsigned function) const
+{
+    assert(function < m_functionCount);
+    return load<uint64_t>(m_section + 16 + function * functionRecordSize());
+}
+
+uint64_t CompactStackMaps::stackSize(unsigned function) const
+{
+    assert(function < m_functionCount);
+    return load<uint64_t>(m_section + 16 + function * functionRecordSize() + 8);
+}
+
+bool CompactStackMaps::find(uint32_t id, Record& result) const
+{
+    auto found = std::lower_bound(m_index.begin(), m_index.end(), id,
+        [](const Record::Entry& entry, uint32_t id) { return entry.m_id < id; });
+    if (found == m_index.end() || found->m_id != id)
+        return false;
+    result = Record(*this, &*found);
+    return true;
+}
+
+unsigned CompactStackMaps::Record::locationCount() const
+{
+    return load<uint16_t>(m_maps->m_section + m_entry->m_offset + 14);
+}
+
+StackMaps::Location CompactStackMaps::Record::location(unsigned index) const
+{
+    assert(index < locationCount());
+    const uint8_t* p = m_maps->m_section + m_entry->m_offset + 16 + index * m_maps->locationSize();
+    StackMaps::Location result;
+    result.kind = static_cast<StackMaps::Location::Kind>(p[0]);
+    if (m_maps->m_version >= 2) {
+        result.size = load<uint16_t>(p + 2);
+        result.dwarfReg = DWARFRegister(load<uint16_t>(p + 4));
+        result.offset = load<int32_t>(p + 8);
+    } else {
+        result.size = p[1];
+        result.dwarfReg = DWARFRegister(load<uint16_t>(p + 2));
+        result.offset = load<int32_t>(p + 4);
+    }
+    return result;
+}
+
+const uint8_t* CompactStackMaps::Record::liveOuts() const
+{
+    size_t offset = m_entry->m_offset + 16 + locationCount() * m_maps->locationSize();
+    if (m_maps->m_version >= 2)
+        offset = alignTo8(offset);
+    return m_maps->m_section + offset;
+}
+
+unsigned CompactStackMaps::Record::liveOutCount() const
+{
+    return load<uint16_t>(liveOuts() + 2);
+}
+
+StackMaps::LiveOut CompactStackMaps::Record::liveOut(unsigned index) const
+{
+    assert(index < liveOutCount());
+    const uint8_t* p = liveOuts() + 4 + index * 4;
+    StackMaps::LiveOut result;
+    result.dwarfReg = DWARFRegister(load<uint16_t>(p));
+    result.size = p[3];
+    return result;
+}
+
+RegisterSet CompactStackMaps::Record::liveOutsSet() const
+{
+    RegisterSet result;
+    for (unsigned i = liveOutCount(); i--;) {
+        Reg reg = liveOut(i).dwarfReg.reg();
+        // Registers without a number here, such as the flags, are left out.
+        if (reg.val() != Reg::invalid())
+            result.set(reg.val() + (reg.isFloat() ? 32 : 0));
+    }
+    return result;
+}
 }
@@ -47,6 +47,7 @@ struct StackMaps {
     struct StackSize {
         uint64_t functionOffset;
         uint64_t size;
+        uint64_t recordCount;
 
         void parse(ParseContext&);
     };
@@ -69,11 +70,8 @@ struct StackMaps {
         void parse(ParseContext&);
     };
 
-    // FIXME: Investigate how much memory this takes and possibly prune it from the
-    // format we keep around in FTL::JITCode. I suspect that it would be most awesome to
-    // have a CompactStackMaps struct that lossily stores only that subset of StackMaps
-    // and Record that we actually need for OSR exit.
-    // https://bugs.webkit.org/show_bug.cgi?id=130802
+    // CompactStackMaps below is the cheaper way to read a section when only the
+    // records are needed.
     struct LiveOut {
         DWARFRegister dwarfReg;
         uint8_t size;
@@ -108,5 +106,76 @@ struct StackMaps {
 
     unsigned stackSize() const;
 };
+
+// Reads an llvm_stackmaps section (version 1 and later) in place. parse()
+// only walks the section to build a flat index of its records sorted by
+// patchpoint id; locations and live outs are decoded when asked for. The
+// index keeps its capacity, so an object reused across compiles does not
+// allocate once warm. The section must outlive the records handed out.
+class CompactStackMaps {
+public:
+    class Record {
+    public:
+        Record()
+            : m_maps(nullptr)
+            , m_entry(nullptr)
+        {
+        }
+        inline uint32_t patchpointID() const { return m_entry->m_id; }
+        inline uint32_t instructionOffset() const { return m_entry->m_instructionOffset; }
+        // Index of the function in the section, i.e. in the stack size records.
+        inline unsigned function() const { return m_entry->m_function; }
+
+        unsigned locationCount() const;
+        StackMaps::Location location(unsigned index) const;
+        unsigned liveOutCount() const;
+        StackMaps::LiveOut liveOut(unsigned index) const;
+        RegisterSet liveOutsSet() const;
+
+    private:
+        friend class CompactStackMaps;
+        struct Entry {
+            uint32_t m_id;
+            uint32_t m_instructionOffset;
+            uint32_t m_offset; // of the record in the section
+            uint32_t m_function;
+        };
+        Record(const CompactStackMaps& maps, const Entry* entry)
+            : m_maps(&maps)
+            , m_entry(entry)
+        {
+        }
+        const uint8_t* liveOuts() const;
+
+        const CompactStackMaps* m_maps;
+        const Entry* m_entry;
+    };
+
+    CompactStackMaps();
+    // Returns false if LLVM signaled a compile failure through the section.
+    bool parse(const uint8_t* section);
+
+    inline unsigned version() const { return m_version; }
+    inline unsigned functionCount() const { return m_functionCount; }
+    // Address of a function as relocated into the section.
+    uint64_t functionAddress(unsigned function) const;
+    uint64_t stackSize(unsigned function) const;
+
+    inline size_t recordCount() const { return m_index.size(); }
+    // Records in patchpoint id order.
+    inline Record record(size_t index) const { return Record(*this, &m_index[index]); }
+    // Returns false if there is no record for |id|; patchpoint ids that
+    // appear more than once give the first of them.
+    bool find(uint32_t id, Record& result) const;
+
+private:
+    inline size_t locationSize() const { return m_version >= 2 ? 12 : 8; }
+    inline size_t functionRecordSize() const { return m_version >= 2 ? 24 : 16; }
+
+    const uint8_t* m_section;
+    unsigned m_version;
+    unsigned m_functionCount;
+    std::vector<Record::Entry> m_index;
+};
 }
 #endif /* STACKMAPS_H */
@@ -0,0 +1,119 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "TranslationCache.h"
+
+namespace jit {
+
+TranslationCache::TranslationCache(unsigned log2Buckets)
+    : m_buckets(nullptr)
+    , m_mask((static_cast<size_t>(1) << log2Buckets) - 1)
+    , m_shift(64 - log2Buckets)
+    , m_size(0)
+    , m_used(0)
+    , m_generation(0)
+{
+    void* buckets;
+    if (posix_memalign(&buckets, sizeof(Bucket), sizeof(Bucket) * (m_mask + 1))) {
+        LOGE("FATAL: Could not allocate translation cache.");
+        assert(false);
+    }
+    // All ones: emptyPC.
+    memset(buckets, 0xff, sizeof(Bucket) * (m_mask + 1));
+    m_buckets = static_cast<Bucket*>(buckets);
+}
+
+TranslationCache::~TranslationCache()
+{
+    free(m_buckets);
+}
+
+TranslationCache::Entry* TranslationCache::find(uintptr_t pc)
+{
+    for (size_t index = bucketIndex(pc);; index = (index + 1) & m_mask) {
+        for (Entry& entry : m_buckets[index].m_entries) {
+            uintptr_t key = entry.m_pc.load(std::memory_order_relaxed);
+            if (key == pc)
+                return &entry;
+            if (key == emptyPC)
+                return nullptr;
+        }
+    }
+}
+
+bool TranslationCache::insert(uintptr_t pc, void* code)
+{
+    assert(pc != emptyPC && pc != deletedPC);
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (Entry* entry = find(pc)) {
+        if (entry->m_entry.load(std::memory_order_relaxed) == code)
+            return true;
+        entry->m_entry.store(code, std::memory_order_release);
+        m_generation.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+    // Keep at least a quarter of the slots empty so that probing terminates
+    // quickly.
+    if ((m_used + 1) * 4 > capacity() * 3)
+        return false;
+    for (size_t index = bucketIndex(pc);; index = (index + 1) & m_mask) {
+        for (Entry& entry : m_buckets[index].m_entries) {
+            uintptr_t key = entry.m_pc.load(std::memory_order_relaxed);
+            if (key != emptyPC && key != deletedPC)
+                continue;
+            if (key == emptyPC)
+                m_used++;
+            m_size++;
+            entry.m_entry.store(code, std::memory_order_relaxed);
+            entry.m_pc.store(pc, std::memory_order_release);
+            return true;
+        }
+    }
+}
+
+void TranslationCache::remove(uintptr_t pc)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    Entry* entry = find(pc);
+    if (!entry)
+        return;
+    entry->m_pc.store(deletedPC, std::memory_order_release);
+    m_size--;
+    m_generation.fetch_add(1, std::memory_order_release);
+}
+
+size_t TranslationCache::removeRange(const void* begin, const void* end)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    size_t removed = 0;
+    for (size_t index = 0; index <= m_mask; ++index) {
+        for (Entry& entry : m_buckets[index].m_entries) {
+            uintptr_t key = entry.m_pc.load(std::memory_order_relaxed);
+            if (key == emptyPC || key == deletedPC)
+                continue;
+            void* code = entry.m_entry.load(std::memory_order_relaxed);
+            if (code < begin || code >= end)
+                continue;
+            entry.m_pc.store(deletedPC, std::memory_order_release);
+            m_size--;
+            removed++;
+        }
+    }
+    if (removed)
+        m_generation.fetch_add(1, std::memory_order_release);
+    return removed;
+}
+
+void TranslationCache::clear()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    for (size_t index = 0; index <= m_mask; ++index) {
+        for (Entry& entry : m_buckets[index].m_entries)
+            entry.m_pc.store(emptyPC, std::memory_order_release);
+    }
+    m_size = 0;
+    m_used = 0;
+    m_generation.fetch_add(1, std::memory_order_release);
+}
+}
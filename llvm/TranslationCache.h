@@ -0,0 +1,80 @@
+#ifndef TRANSLATIONCACHE_H
+#define TRANSLATIONCACHE_H
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace jit {
+
+// Maps guest pc to the executable entry point of its translation. The table
+// is open addressed over cache line sized buckets, so a hit normally touches
+// a single line. Lookups are lock free; updates are serialized by a mutex.
+// Guest pcs ~0 and ~0 - 1 mark empty and deleted slots and are never cached;
+// no guest instruction starts in the last two bytes of the address space.
+class TranslationCache {
+public:
+    explicit TranslationCache(unsigned log2Buckets = 14);
+    ~TranslationCache();
+    TranslationCache(const TranslationCache&) = delete;
+    const TranslationCache& operator=(const TranslationCache&) = delete;
+
+    inline void* lookup(uintptr_t pc) const
+    {
+        for (size_t index = bucketIndex(pc);; index = (index + 1) & m_mask) {
+            const Bucket& bucket = m_buckets[index];
+            for (const Entry& entry : bucket.m_entries) {
+                uintptr_t key = entry.m_pc.load(std::memory_order_acquire);
+                if (key == pc)
+                    return entry.m_entry.load(std::memory_order_relaxed);
+                if (key == emptyPC)
+                    return nullptr;
+            }
+        }
+    }
+
+    // Returns false if the table is full.
+    bool insert(uintptr_t pc, void* entry);
+    void remove(uintptr_t pc);
+    // Removes every translation whose entry is in [begin, end). Returns how
+    // many there were.
+    size_t removeRange(const void* begin, const void* end);
+    void clear();
+
+    // Bumped whenever a translation goes away, so that copies of the table
+    // kept elsewhere know when to drop their entries.
+    inline uint64_t generation() const { return m_generation.load(std::memory_order_acquire); }
+
+    inline size_t size() const { return m_size; }
+    inline size_t capacity() const { return (m_mask + 1) * entriesPerBucket; }
+
+private:
+    static const uintptr_t emptyPC = ~static_cast<uintptr_t>(0);
+    static const uintptr_t deletedPC = ~static_cast<uintptr_t>(1);
+    static const size_t entriesPerBucket = 4;
+
+    struct Entry {
+        std::atomic<uintptr_t> m_pc;
+        std::atomic<void*> m_entry;
+    };
+
+    struct alignas(64) Bucket {
+        Entry m_entries[entriesPerBucket];
+    };
+
+    inline size_t bucketIndex(uintptr_t pc) const
+    {
+        return static_cast<size_t>((pc * 0x9E3779B97F4A7C15ULL) >> m_shift) & m_mask;
+    }
+    Entry* find(uintptr_t pc);
+
+    Bucket* m_buckets;
+    size_t m_mask;
+    unsigned m_shift;
+    size_t m_size;
+    size_t m_used;
+    std::atomic<uint64_t> m_generation;
+    std::mutex m_lock;
+};
+}
+#endif /* TRANSLATIONCACHE_H */
@@ -1,6 +1,7 @@
 #include "log.h"
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <sys/syscall.h> /* For SYS_xxx definitions */
 #ifdef __ANDROID__
@@ -9,14 +10,407 @@
 #endif
 
 #include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #ifdef LLVMLOG_LEVEL
 static FILE* g_log = stdout;
 
+#ifdef __ANDROID__
+static int androidType(char type)
+{
+    switch (type) {
+    case 'V':
+        return ANDROID_LOG_VERBOSE;
+    case 'P':
+    case 'D':
+        return ANDROID_LOG_DEBUG;
+    case 'E':
+        return ANDROID_LOG_ERROR;
+    default:
+        return ANDROID_LOG_INFO;
+    }
+}
+#endif
+
+namespace jit {
+
+// Followed by m_size - sizeof(LogRecordHeader) bytes of arguments. A record
+// with no site pads the buffer up to its end; when less than a header is
+// left there, the space is skipped without one.
+struct LogRecordHeader {
+    uint64_t m_timestamp;
+    const LogSite* m_site;
+    uint32_t m_size;
+    uint32_t m_reserved;
+};
+
+static const size_t logBufferSize = 64 * 1024;
+
+// Single producer, the owning thread, and single consumer, whoever holds
+// the drain lock. Positions only grow; the data wraps around.
+struct LogBuffer {
+    std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_tail;
+    // The owner's end of the record being written.
+    uint64_t m_pending;
+    std::atomic<uint64_t> m_dropped;
+    // Set when the owner exits; the drainer frees the buffer once empty.
+    std::atomic<bool> m_retired;
+    long m_tid;
+    uint8_t m_data[logBufferSize];
+};
+
+struct LogRegistry {
+    std::mutex m_lock;
+    std::vector<LogBuffer*> m_buffers;
+    std::mutex m_drainLock;
+    std::condition_variable m_wakeup;
+    std::thread m_drainer;
+    bool m_stopping = false;
+    uint64_t m_start = 0;
+};
+
+static uint64_t logTimestamp()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+// Never destroyed, so that threads and atexit handlers can log to the end.
+static LogRegistry& registry()
+{
+    static LogRegistry* registry = new LogRegistry;
+    return *registry;
+}
+
+static thread_local LogBuffer* t_buffer;
+
+struct LogBufferRetirer {
+    ~LogBufferRetirer()
+    {
+        if (!t_buffer)
+            return;
+        t_buffer->m_retired.store(true, std::memory_order_release);
+        // Anything logged later in the thread's teardown goes to a new
+        // buffer, never retired.
+        t_buffer = nullptr;
+    }
+};
+static thread_local LogBufferRetirer t_retirer;
+
+static LogBuffer* registerBuffer()
+{
+    LogBuffer* buffer = new LogBuffer;
+    buffer->m_head.store(0, std::memory_order_relaxed);
+    buffer->m_tail.store(0, std::memory_order_relaxed);
+    buffer->m_pending = 0;
+    buffer->m_dropped.store(0, std::memory_order_relaxed);
+    buffer->m_retired.store(false, std::memory_order_relaxed);
+    buffer->m_tid = syscall(__NR_gettid, 0);
+    {
+        LogRegistry& logs = registry();
+        std::lock_guard<std::mutex> guard(logs.m_lock);
+        logs.m_buffers.push_back(buffer);
+    }
+    // Gets the retirer constructed, and so destroyed, for this thread.
+    (void)&t_retirer;
+    t_buffer = buffer;
+    return buffer;
+}
+
+uint8_t* logBegin(const LogSite* site, size_t argSize)
+{
+    LogBuffer* buffer = t_buffer ? t_buffer : registerBuffer();
+    size_t size = sizeof(LogRecordHeader) + argSize;
+    uint64_t head = buffer->m_head.load(std::memory_order_relaxed);
+    uint64_t tail = buffer->m_tail.load(std::memory_order_acquire);
+    size_t offset = head & (logBufferSize - 1);
+    size_t padding = offset + size > logBufferSize ? logBufferSize - offset : 0;
+    if (size > logBufferSize / 4 || head + padding + size - tail > logBufferSize) {
+        buffer->m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    if (padding) {
+        if (padding >= sizeof(LogRecordHeader)) {
+            LogRecordHeader* header = reinterpret_cast<LogRecordHeader*>(buffer->m_data + offset);
+            header->m_site = nullptr;
+            header->m_size = padding;
+        }
+        head += padding;
+        offset = 0;
+    }
+    LogRecordHeader* header = reinterpret_cast<LogRecordHeader*>(buffer->m_data + offset);
+    header->m_timestamp = logTimestamp();
+    header->m_site = site;
+    header->m_size = size;
+    buffer->m_pending = head + size;
+    return reinterpret_cast<uint8_t*>(header + 1);
+}
+
+void logEnd()
+{
+    t_buffer->m_head.store(t_buffer->m_pending, std::memory_order_release);
+}
+
+static void formatRecord(const LogRecordHeader* header, std::string& line)
+{
+    const uint8_t* args = reinterpret_cast<const uint8_t*>(header + 1);
+    const uint8_t* end = reinterpret_cast<const uint8_t*>(header) + header->m_size;
+    const char* format = header->m_site->m_format;
+    char text[logStringLimit + 64];
+    while (*format) {
+        if (*format != '%') {
+            line += *format++;
+            continue;
+        }
+        if (format[1] == '%') {
+            line += '%';
+            format += 2;
+            continue;
+        }
+        std::string spec(1, *format++);
+        while (*format && strchr("-+ #0", *format))
+            spec += *format++;
+        // A * width or precision comes as an int argument of its own.
+        bool missing = false;
+        auto digits = [&](bool precision) {
+            if (*format != '*') {
+                while (*format >= '0' && *format <= '9')
+                    spec += *format++;
+                return;
+            }
+            format++;
+            if (args + sizeof(uint64_t) > end) {
+                missing = true;
+                return;
+            }
+            uint64_t slot;
+            memcpy(&slot, args, sizeof(slot));
+            args += sizeof(slot);
+            int value = static_cast<int>(slot);
+            // A negative precision is taken as none.
+            if (precision && value < 0)
+                spec.pop_back();
+            else
+                spec += std::to_string(value);
+        };
+        digits(false);
+        if (*format == '.') {
+            spec += *format++;
+            digits(true);
+        }
+        // Every argument was widened to 64 bits.
+        while (*format && strchr("hlLqjzt", *format))
+            format++;
+        char conversion = *format;
+        if (!conversion)
+            break;
+        format++;
+        if (missing || args + sizeof(uint64_t) > end) {
+            line += "<missing>";
+            continue;
+        }
+        uint64_t slot;
+        memcpy(&slot, args, sizeof(slot));
+        args += sizeof(slot);
+        switch (conversion) {
+        case 'd':
+        case 'i':
+            spec += "ll";
+            spec += conversion;
+            snprintf(text, sizeof(text), spec.c_str(), static_cast<long long>(slot));
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            spec += "ll";
+            spec += conversion;
+            snprintf(text, sizeof(text), spec.c_str(), static_cast<unsigned long long>(slot));
+            break;
+        case 'c':
+            spec += conversion;
+            snprintf(text, sizeof(text), spec.c_str(), static_cast<int>(slot));
+            break;
+        case 'p':
+            spec += conversion;
+            snprintf(text, sizeof(text), spec.c_str(), reinterpret_cast<void*>(static_cast<uintptr_t>(slot)));
+            break;
+        case 's': {
+            spec += conversion;
+            if (slot == UINT64_MAX) {
+                snprintf(text, sizeof(text), spec.c_str(), "(null)");
+                break;
+            }
+            std::string string(reinterpret_cast<const char*>(args), slot);
+            args += (slot + 7) & ~static_cast<uint64_t>(7);
+            snprintf(text, sizeof(text), spec.c_str(), string.c_str());
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A': {
+            double value;
+            memcpy(&value, &slot, sizeof(value));
+            spec += conversion;
+            snprintf(text, sizeof(text), spec.c_str(), value);
+            break;
+        }
+        default:
+            snprintf(text, sizeof(text), "<%%%c?>", conversion);
+            break;
+        }
+        line += text;
+    }
+    if (line.empty() || line.back() != '\n')
+        line += '\n';
+}
+
+static void writeLine(char type, long tid, uint64_t timestamp, const std::string& text)
+{
+#ifndef __ANDROID__
+    fprintf(g_log, "%c:%ld:%lu: %s", type, tid, static_cast<unsigned long>(timestamp / 1000), text.c_str());
+#else
+    (void)tid;
+    (void)timestamp;
+    __android_log_write(androidType(type), TAG, text.c_str());
+#endif
+}
+
+namespace {
+struct PendingRecord {
+    uint64_t m_timestamp;
+    const LogBuffer* m_buffer;
+    const LogRecordHeader* m_header;
+};
+}
+
+// Call with the drain lock held.
+static void drain(LogRegistry& logs)
+{
+    std::vector<LogBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> guard(logs.m_lock);
+        buffers = logs.m_buffers;
+    }
+    std::vector<PendingRecord> records;
+    std::vector<uint64_t> heads(buffers.size());
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        LogBuffer* buffer = buffers[i];
+        uint64_t head = buffer->m_head.load(std::memory_order_acquire);
+        heads[i] = head;
+        for (uint64_t position = buffer->m_tail.load(std::memory_order_relaxed); position < head;) {
+            size_t offset = position & (logBufferSize - 1);
+            if (logBufferSize - offset < sizeof(LogRecordHeader)) {
+                position += logBufferSize - offset;
+                continue;
+            }
+            const LogRecordHeader* header = reinterpret_cast<const LogRecordHeader*>(buffer->m_data + offset);
+            if (header->m_site)
+                records.push_back({ header->m_timestamp, buffer, header });
+            position += header->m_size;
+        }
+    }
+    std::stable_sort(records.begin(), records.end(), [](const PendingRecord& a, const PendingRecord& b) {
+        return a.m_timestamp < b.m_timestamp;
+    });
+    if (!logs.m_start && !records.empty())
+        logs.m_start = records.front().m_timestamp;
+    std::string line;
+    for (auto& record : records) {
+        line.clear();
+        formatRecord(record.m_header, line);
+        uint64_t elapsed = record.m_timestamp > logs.m_start ? record.m_timestamp - logs.m_start : 0;
+        writeLine(record.m_header->m_site->m_type, record.m_buffer->m_tid, elapsed, line);
+    }
+
+    std::vector<LogBuffer*> retired;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        LogBuffer* buffer = buffers[i];
+        buffer->m_tail.store(heads[i], std::memory_order_release);
+        if (uint64_t dropped = buffer->m_dropped.exchange(0, std::memory_order_relaxed))
+            writeLine('E', buffer->m_tid, logTimestamp() - logs.m_start, std::to_string(dropped) + " log records dropped.\n");
+        if (buffer->m_retired.load(std::memory_order_acquire) && buffer->m_head.load(std::memory_order_acquire) == heads[i])
+            retired.push_back(buffer);
+    }
+#ifndef __ANDROID__
+    fflush(g_log);
+#endif
+    if (retired.empty())
+        return;
+    std::lock_guard<std::mutex> guard(logs.m_lock);
+    for (LogBuffer* buffer : retired) {
+        logs.m_buffers.erase(std::find(logs.m_buffers.begin(), logs.m_buffers.end(), buffer));
+        delete buffer;
+    }
+}
+
+void logFlush()
+{
+    if (!g_log)
+        return;
+    LogRegistry& logs = registry();
+    std::lock_guard<std::mutex> guard(logs.m_drainLock);
+    drain(logs);
+}
+
+void logStartDrainer(unsigned intervalMs)
+{
+    LogRegistry& logs = registry();
+    std::lock_guard<std::mutex> guard(logs.m_drainLock);
+    if (logs.m_drainer.joinable() || logs.m_stopping)
+        return;
+    logs.m_drainer = std::thread([&logs, intervalMs] {
+        std::unique_lock<std::mutex> lock(logs.m_drainLock);
+        while (!logs.m_stopping) {
+            logs.m_wakeup.wait_for(lock, std::chrono::milliseconds(intervalMs));
+            if (g_log)
+                drain(logs);
+        }
+    });
+}
+
+static void logExit()
+{
+    LogRegistry& logs = registry();
+    {
+        std::lock_guard<std::mutex> guard(logs.m_drainLock);
+        logs.m_stopping = true;
+    }
+    logs.m_wakeup.notify_one();
+    if (logs.m_drainer.joinable())
+        logs.m_drainer.join();
+    logFlush();
+}
+
+// Registered before main runs, so that it comes after every atexit handler
+// registered from there on and drains what they logged.
+static struct LogExitRegistration {
+    LogExitRegistration()
+    {
+        atexit(logExit);
+    }
+} logExitRegistration;
+}
+
 void __my_log(char type, const char* fmt, ...)
 {
     if (!g_log)
         return;
+    // Keep the order with what C++ code logged.
+    jit::logFlush();
     va_list args;
     va_start(args, fmt);
     int bytes = vsnprintf(nullptr, 0, fmt, args);
@@ -34,28 +428,17 @@ void __my_log(char type, const char* fmt, ...)
     fputs(buf, g_log);
     fflush(g_log);
 #else
-    int android_type;
-    switch (type) {
-    case 'V':
-        android_type = ANDROID_LOG_VERBOSE;
-        break;
-    case 'P':
-    case 'D':
-        android_type = ANDROID_LOG_DEBUG;
-        break;
-    case 'E':
-        android_type = ANDROID_LOG_ERROR;
-        break;
-    default:
-        android_type = ANDROID_LOG_INFO;
-        break;
-    }
-    __android_log_write(android_type, TAG, buf);
+    __android_log_write(androidType(type), TAG, buf);
 #endif
 }
 
+void __my_log_check(const char*, ...)
+{
+}
+
 void __my_assert_fail(const char* msg, const char* file_name, int lineno)
 {
+    jit::logFlush();
 #ifndef __ANDROID__
     if (!g_log) {
         __builtin_trap();
@@ -1,34 +1,166 @@
 #ifndef LOG_H
 #define LOG_H
 #ifdef LLVMLOG_LEVEL
+#ifdef __cplusplus
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// In C++ a log call only copies its arguments into a ring buffer of the
+// calling thread, without locks or system calls; formatting happens when the
+// buffers are drained. See logFlush() and logStartDrainer().
+#define LLVMLOG_RECORD(type, format, ...)                     \
+    do {                                                      \
+        static const ::jit::LogSite __log_site = { type, format }; \
+        if (false)                                            \
+            __my_log_check(format, ##__VA_ARGS__);            \
+        ::jit::logRecord(&__log_site, ##__VA_ARGS__);         \
+    } while (0)
+
+// always print LOGE, right away
+#define LOGE(...)                        \
+    do {                                 \
+        LLVMLOG_RECORD('E', __VA_ARGS__); \
+        ::jit::logFlush();               \
+    } while (0)
+#else
+#define LLVMLOG_RECORD(type, ...) __my_log(type, __VA_ARGS__)
 // always print LOGE
 #define LOGE(...) __my_log('E', __VA_ARGS__)
+#endif //__cplusplus
 #define EMASSERT(p)                               \
     if (!(p)) {                                   \
         __my_assert_fail(#p, __FILE__, __LINE__); \
     }
 
 #if LLVMLOG_LEVEL >= 10
-#define LOGV(...) __my_log('V', __VA_ARGS__)
+#define LOGV(...) LLVMLOG_RECORD('V', __VA_ARGS__)
 #endif // DEFINING LOGV
 
 #if LLVMLOG_LEVEL >= 4
 // debug log
-#define LOGD(...) __my_log('D', __VA_ARGS__)
+#define LOGD(...) LLVMLOG_RECORD('D', __VA_ARGS__)
 #endif
 
 #if LLVMLOG_LEVEL >= 5
 // performance log
-#define LOGP(...) __my_log('P', __VA_ARGS__)
+#define LOGP(...) LLVMLOG_RECORD('P', __VA_ARGS__)
 #endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif //__cplusplus
 void __my_log(char type, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+// Never called, only checks the arguments of a record against its format.
+void __my_log_check(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
 void __my_assert_fail(const char* msg, const char* file_name, int lineno) __attribute__((noreturn));
 #ifdef __cplusplus
 }
+
+namespace jit {
+// One per log call site; its address identifies the format of a record.
+struct LogSite {
+    char m_type;
+    const char* m_format;
+};
+
+// Longer strings are cut.
+static const size_t logStringLimit = 256;
+
+// Arguments are kept in 8 byte slots: integers widened to 64 bits, floating
+// point as double, and strings as their length followed by their bytes.
+inline size_t logStringLength(const char* string)
+{
+    return string ? strnlen(string, logStringLimit) : 0;
+}
+
+inline size_t logArgSize(const char* string)
+{
+    return sizeof(uint64_t) + ((logStringLength(string) + 7) & ~static_cast<size_t>(7));
+}
+
+inline size_t logArgSize(char* string)
+{
+    return logArgSize(static_cast<const char*>(string));
+}
+
+template <typename T>
+inline size_t logArgSize(T)
+{
+    static_assert(sizeof(T) <= sizeof(uint64_t), "log arguments must fit in 64 bits");
+    return sizeof(uint64_t);
+}
+
+inline uint8_t* logPut(uint8_t* p, const char* string)
+{
+    uint64_t length = string ? logStringLength(string) : UINT64_MAX;
+    memcpy(p, &length, sizeof(length));
+    if (string)
+        memcpy(p + sizeof(length), string, length);
+    return p + logArgSize(string);
+}
+
+inline uint8_t* logPut(uint8_t* p, char* string)
+{
+    return logPut(p, static_cast<const char*>(string));
+}
+
+inline uint8_t* logPut(uint8_t* p, double value)
+{
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(uint64_t);
+}
+
+inline uint8_t* logPut(uint8_t* p, float value)
+{
+    return logPut(p, static_cast<double>(value));
+}
+
+template <typename T>
+inline uint8_t* logPut(uint8_t* p, T* pointer)
+{
+    uint64_t value = reinterpret_cast<uintptr_t>(pointer);
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(uint64_t);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint8_t*>::type logPut(uint8_t* p, T value)
+{
+    int64_t widened = static_cast<int64_t>(value);
+    memcpy(p, &widened, sizeof(widened));
+    return p + sizeof(uint64_t);
+}
+
+// Reserves a record of |argSize| bytes of arguments in the calling thread's
+// buffer, or returns nullptr, counting the record as dropped, if it is full.
+uint8_t* logBegin(const LogSite* site, size_t argSize);
+// Hands the record over to the drainer.
+void logEnd();
+
+template <typename... Args>
+inline void logRecord(const LogSite* site, Args... args)
+{
+    size_t sizes[] = { 0, logArgSize(args)... };
+    size_t argSize = 0;
+    for (size_t size : sizes)
+        argSize += size;
+    uint8_t* p = logBegin(site, argSize);
+    if (!p)
+        return;
+    uint8_t* ends[] = { p, (p = logPut(p, args))... };
+    (void)ends;
+    logEnd();
+}
+
+// Formats the records of every thread so far, in timestamp order. Also
+// done at exit.
+void logFlush();
+// Drains from a background thread every |intervalMs| milliseconds, until
+// exit.
+void logStartDrainer(unsigned intervalMs = 100);
+}
 #endif //__cplusplus
 #endif // LLVMLOG_LEVEL
 
@@ -1,19 +1,31 @@
 #include <assert.h>
+#include <memory>
 #include <string.h>
 #include <stdlib.h>
 #include "InitializeLLVM.h"
+#include "CodeCache.h"
 #include "CompilerState.h"
 #include "Output.h"
 #include "Compile.h"
 #include "Link.h"
+#include "TranslationCache.h"
+#include "Dispatcher.h"
+#include "BlockChainer.h"
+#include "CompileService.h"
+#include "PersistentCache.h"
+#include "CompileStats.h"
 #include "Registers.h"
+#include "SoftTLB.h"
 #include "log.h"
 typedef jit::CompilerState State;
 
-static void myexit(void)
-{
-    exit(1);
-}
+static const uintptr_t entryPC = 0x1000;
+static const uintptr_t loopPC = 0x2000;
+static const uintptr_t regionPC = 0x3000;
+// Guest pc 0 is as good a target as any other.
+static const uintptr_t zeroPC = 0;
+// Nothing is there, so the run ends once the guest gets there.
+static const uintptr_t exitPC = 0x4000;
 
 static void buildIR(State& state)
 {
@@ -29,28 +41,142 @@ static void buildIR(State& state)
     LValue add = output.buildAdd(val, one);
     LValue result = output.buildSelect(output.buildICmp(LLVMIntNE, indicator, output.constIntPtr(0)), add, val);
     output.buildStoreArgIndex(result, 0);
+    // Narrow stores into the 256-bit vector register 0 keep its upper lanes:
+    // 128 bits from register 1, as movdqa does, then 64 bits, as movq does.
+    output.buildStoreVector(output.buildLoadVector(1, output.vectorType(output.repo().int64, 2)), 0);
+    output.buildStoreVector(output.constIntPtr(3), 0);
 
     LBasicBlock patch = output.appendBasicBlock("Patch");
     output.buildBr(patch);
     output.positionToBBEnd(patch);
-    output.buildDirectPatch(reinterpret_cast<uintptr_t>(myexit));
+    output.buildDirectPatch(loopPC);
 }
 
-static void mydispIndirect(void)
+// Sums the loop counts into context[3], called in line from the loop block.
+static uint64_t myassist(void* context, uint64_t count)
 {
-    printf("%s.\n", __FUNCTION__);
+    intptr_t* slots = static_cast<intptr_t*>(context);
+    // Registers are written back for the call.
+    assert(slots[1] == static_cast<intptr_t>(count));
+    assert(!(reinterpret_cast<uintptr_t>(__builtin_frame_address(0)) & 15));
+    slots[3] += count;
+    return slots[3];
 }
 
-static void mydispDirect(void)
+// Guest memory, 16 pages from guest address 0, mapped through the soft TLB.
+static const unsigned guestPageShift = 12;
+// Guest vector registers are as wide as a host ymm.
+static const size_t vectorSize = 32;
+alignas(4096) static uint8_t guestMemory[16 << guestPageShift];
+static const PlatformDesc* tlbDesc;
+static unsigned tlbMisses;
+
+template <unsigned size>
+static uint64_t mytlbmiss(void* context, uint64_t address)
 {
-    printf("%s.\n", __FUNCTION__);
+    assert(address + size <= sizeof(guestMemory));
+    ++tlbMisses;
+    // Guest pages are contiguous in the host, so accesses crossing a page
+    // need nothing more.
+    uint64_t page = address & ~((static_cast<uint64_t>(1) << guestPageShift) - 1);
+    jit::fillSoftTLB(context, *tlbDesc, address, guestMemory + page, true);
+    return reinterpret_cast<uintptr_t>(guestMemory + address);
 }
 
-static void mydispAssist(void)
+static void buildLoopIR(State& state)
 {
-    printf("%s.\n", __FUNCTION__);
+    using namespace jit;
+    Output output(state);
+    LBasicBlock body = output.appendBasicBlock("Body");
+    output.buildBr(body);
+    output.positionToBBEnd(body);
+    LValue count = output.buildAdd(output.buildLoadArgIndex(1), output.constIntPtr(1));
+    output.buildStoreArgIndex(count, 1);
+    LValue sum = output.buildAssistCall(reinterpret_cast<uintptr_t>(myassist), count);
+    output.buildStoreArgIndex(sum, 4);
+    // Sums the even counts at guest 0x5000 and the odd ones a page up.
+    LValue address = output.buildAdd(output.constIntPtr(0x5000), output.buildShl(output.buildAnd(count, output.constIntPtr(1)), output.constIntPtr(guestPageShift)));
+    output.buildGuestStore(output.buildAdd(output.buildGuestLoad(address, output.repo().int64), count), address);
+    LValue next = output.buildSelect(output.buildICmp(LLVMIntSLT, count, output.constIntPtr(10)), output.constIntPtr(entryPC), output.constIntPtr(regionPC));
+    output.buildIndirectPatch(next);
 }
 
+// A counted loop of two guest blocks compiled as one region: sums 1 to
+// 10000000 into context[6], counting in context[5]. It is entered once, so
+// it only tiers up through its back-edge.
+static void buildRegionIR(State& state)
+{
+    using namespace jit;
+    Output output(state);
+    LBasicBlock body = output.appendBasicBlock("Body");
+    output.buildBr(body);
+    output.positionToBBEnd(body);
+    output.buildRegionBlock(regionPC);
+    LValue i = output.buildLoadArgIndex(5);
+    output.buildRegionCondBranch(output.buildICmp(LLVMIntSLT, i, output.constIntPtr(10000000)), regionPC + 0x10, zeroPC);
+    output.buildRegionBlock(regionPC + 0x10);
+    LValue next = output.buildAdd(output.buildLoadArgIndex(5), output.constIntPtr(1));
+    output.buildStoreArgIndex(next, 5);
+    output.buildStoreArgIndex(output.buildAdd(output.buildLoadArgIndex(6), next), 6);
+    output.buildRegionBranch(regionPC);
+}
+
+// Marks context[7] on the way out.
+static void buildZeroIR(State& state)
+{
+    using namespace jit;
+    Output output(state);
+    LBasicBlock body = output.appendBasicBlock("Body");
+    output.buildBr(body);
+    output.positionToBBEnd(body);
+    output.buildStoreArgIndex(output.constIntPtr(7), 7);
+    output.buildDirectPatch(exitPC);
+}
+
+extern "C" {
+void* myenter(void* context, void* entry);
+void mydispDirect(void);
+void mydispIndirect(void);
+void mydispAssist(void);
+}
+
+// Translations are entered with the context in %rbp and leave through their
+// patch points with %rsp back at its value on entry. Only the callee saved
+// registers of myenter's caller need to survive.
+asm(".text\n"
+    ".globl myenter\n"
+    "myenter:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    movq %rdi, %rbp\n"
+    "    callq *%rsi\n"
+    "    ud2\n"
+    ".globl mydispDirect\n"
+    "mydispDirect:\n"
+    // return the patch site pushed by call *%r11 for chaining
+    "    popq %rax\n"
+    "    jmp 1f\n"
+    ".globl mydispIndirect\n"
+    "mydispIndirect:\n"
+    ".globl mydispAssist\n"
+    "mydispAssist:\n"
+    "    xorl %eax, %eax\n"
+    "1:\n"
+    // drop the return address into myenter and the alignment slot
+    "    addq $16, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n");
+
 inline static uint8_t rexAMode_R__wrk(unsigned gregEnc3210, unsigned eregEnc3210)
 {
     uint8_t W = 1; /* we want 64-bit mode */
@@ -103,6 +229,21 @@ static void patchProloge(void*, uint8_t* start, uint8_t* end)
     memset(p, 0x90, static_cast<size_t>(end - p));
 }
 
+static uint8_t* emitUnchained(uint8_t* p)
+{
+    /* 10 bytes: movabsq $target, %r11 */
+    *p++ = 0x49;
+    *p++ = 0xBB;
+    p = emit64(p, reinterpret_cast<uintptr_t>(mydispDirect));
+    /* movq %r11, RIP(%rbp) */
+
+    /* 3 bytes: call*%r11 */
+    *p++ = 0x41;
+    *p++ = 0xFF;
+    *p++ = 0xD3;
+    return p;
+}
+
 static void patchDirect(void*, uint8_t* p)
 {
     // epilogue
@@ -116,16 +257,36 @@ static void patchDirect(void*, uint8_t* p)
     // 1 bytes pop rbp
     *p++ = 0x5d;
 
-    /* 10 bytes: movabsq $target, %r11 */
-    *p++ = 0x49;
-    *p++ = 0xBB;
-    p = emit64(p, reinterpret_cast<uintptr_t>(mydispDirect));
-    /* movq %r11, RIP(%rbp) */
+    emitUnchained(p);
+}
 
-    /* 3 bytes: call*%r11 */
-    *p++ = 0x41;
-    *p++ = 0xFF;
-    *p++ = 0xD3;
+static void chainDirect(void*, uint8_t* p, uint8_t* executable, void* target)
+{
+    // keep the 4 bytes epilogue
+    uint8_t* start = p;
+    p += 4;
+    executable += 4;
+    if (!target) {
+        emitUnchained(p);
+        return;
+    }
+    intptr_t delta = static_cast<uint8_t*>(target) - (executable + 5);
+    if (delta == static_cast<int32_t>(delta)) {
+        /* 5 bytes: jmp rel32 */
+        *p++ = 0xE9;
+        *reinterpret_cast<int32_t*>(p) = static_cast<int32_t>(delta);
+        p += 4;
+    } else {
+        /* 10 bytes: movabsq $target, %r11 */
+        *p++ = 0x49;
+        *p++ = 0xBB;
+        p = emit64(p, reinterpret_cast<uintptr_t>(target));
+        /* 3 bytes: jmp *%r11 */
+        *p++ = 0x41;
+        *p++ = 0xFF;
+        *p++ = 0xE3;
+    }
+    memset(p, 0x90, static_cast<size_t>(start + 17 - p));
 }
 
 static void patchIndirect(void*, uint8_t* p)
@@ -153,6 +314,28 @@ static void patchIndirect(void*, uint8_t* p)
     *p++ = 0xE3;
 }
 
+static void patchIndirectJump(void*, uint8_t* p, int reg)
+{
+    uint8_t* start = p;
+    // epilogue
+
+    // 3 bytes
+    *p++ = rexAMode_R(jit::RBP,
+        jit::RDI);
+    *p++ = 0x89;
+    p = doAMode_R(p, jit::RBP,
+        jit::RSP);
+    // 1 bytes pop rbp
+    *p++ = 0x5d;
+
+    /* 2 or 3 bytes: jmp *%reg */
+    if (reg >= 8)
+        *p++ = 0x41;
+    *p++ = 0xFF;
+    p = doAMode_R(p, 4, reg);
+    memset(p, 0x90, static_cast<size_t>(start + 17 - p));
+}
+
 static void patchAssist(void*, uint8_t* p)
 {
     // epilogue
@@ -178,6 +361,143 @@ static void patchAssist(void*, uint8_t* p)
     *p++ = 0xE3;
 }
 
+// Registers a helper may clobber, and so that a stub saves when they are live.
+static const uint32_t callerSavedRegisters = 1u << jit::RAX | 1u << jit::RCX | 1u << jit::RDX | 1u << jit::RSI | 1u << jit::RDI
+    | 1u << jit::R8 | 1u << jit::R9 | 1u << jit::R10 | 1u << jit::R11;
+
+static uint8_t* emitMove(uint8_t* p, unsigned dst, unsigned src)
+{
+    /* 3 bytes: movq %src, %dst */
+    *p++ = rexAMode_R(src, dst);
+    *p++ = 0x89;
+    return doAMode_R(p, src, dst);
+}
+
+static uint8_t* emitStackXmm(uint8_t* p, unsigned xmm, int32_t offset, bool store, bool ymm)
+{
+    if (ymm) {
+        /* 9 bytes: vmovdqu %ymm, offset(%rsp) or back */
+        *p++ = 0xC5;
+        *p++ = (xmm >= 8 ? 0x00 : 0x80) | 0x7E;
+    } else {
+        /* 9 or 10 bytes: movdqu %xmm, offset(%rsp) or back */
+        *p++ = 0xF3;
+        if (xmm >= 8)
+            *p++ = 0x44;
+        *p++ = 0x0F;
+    }
+    *p++ = store ? 0x7F : 0x6F;
+    *p++ = mkModRegRM(2, xmm & 7, 4);
+    *p++ = 0x24;
+    *reinterpret_cast<int32_t*>(p) = offset;
+    return p + 4;
+}
+
+static uint8_t* emitAdjustStack(uint8_t* p, int32_t size)
+{
+    /* 7 bytes: subq or addq $size, %rsp */
+    *p++ = 0x48;
+    *p++ = 0x81;
+    *p++ = size > 0 ? 0xEC : 0xC4;
+    *reinterpret_cast<int32_t*>(p) = size > 0 ? size : -size;
+    return p + 4;
+}
+
+// Called from the patch area with the stack aligned as for any call, which
+// anyregcc expects to preserve every register but the result. Only live
+// caller saved registers are spilled, vector ones as wide as they are live.
+static size_t emitAssistStub(void*, uint8_t* buffer, const AssistCallDesc& desc)
+{
+    uint8_t* p = buffer;
+    uint32_t gprs = static_cast<uint32_t>(desc.m_liveRegisters) & callerSavedRegisters;
+    if (desc.m_result >= 0)
+        gprs &= ~(1u << desc.m_result);
+    uint32_t xmms = static_cast<uint32_t>(desc.m_liveRegisters >> 32) & 0xffff;
+    // Upper halves are only live with 32-byte guest vectors, which need AVX.
+    assert(desc.m_floatLiveSize <= vectorSize);
+    bool ymm = desc.m_floatLiveSize > 16;
+    int32_t slot = ymm ? 32 : 16;
+    unsigned pushes = 0;
+    for (unsigned reg = 0; reg < 16; ++reg) {
+        if (!(gprs & 1u << reg))
+            continue;
+        /* 1 or 2 bytes: pushq %reg */
+        if (reg >= 8)
+            *p++ = 0x41;
+        *p++ = 0x50 | (reg & 7);
+        pushes++;
+    }
+    // The return address and the pushes leave the stack misaligned by 8
+    // when there is an even number of pushes.
+    int32_t frame = slot * __builtin_popcount(xmms) + (pushes % 2 ? 0 : 8);
+    p = emitAdjustStack(p, frame);
+    int32_t offset = 0;
+    for (unsigned xmm = 0; xmm < 16; ++xmm) {
+        if (xmms & 1u << xmm) {
+            p = emitStackXmm(p, xmm, offset, true, ymm);
+            offset += slot;
+        }
+    }
+
+    // helper(context, argument), moving whichever would be overwritten first.
+    if (desc.m_argument == jit::RDI && desc.m_context == jit::RSI) {
+        /* 3 bytes: xchgq %rsi, %rdi */
+        *p++ = rexAMode_R(jit::RSI, jit::RDI);
+        *p++ = 0x87;
+        p = doAMode_R(p, jit::RSI, jit::RDI);
+    } else {
+        if (desc.m_argument == jit::RDI)
+            p = emitMove(p, jit::RSI, jit::RDI);
+        if (desc.m_context != jit::RDI)
+            p = emitMove(p, jit::RDI, desc.m_context);
+        if (desc.m_argument < 0) {
+            /* 10 bytes: movabsq $value, %rsi */
+            *p++ = 0x48;
+            *p++ = 0xBE;
+            p = emit64(p, desc.m_argumentValue);
+        } else if (desc.m_argument != jit::RDI && desc.m_argument != jit::RSI)
+            p = emitMove(p, jit::RSI, desc.m_argument);
+    }
+    /* 10 bytes: movabsq $helper, %rax */
+    *p++ = 0x48;
+    *p++ = 0xB8;
+    p = emit64(p, reinterpret_cast<uintptr_t>(desc.m_helper));
+    /* 2 bytes: call *%rax */
+    *p++ = 0xFF;
+    *p++ = 0xD0;
+    if (desc.m_result >= 0 && desc.m_result != jit::RAX)
+        p = emitMove(p, desc.m_result, jit::RAX);
+
+    offset = 0;
+    for (unsigned xmm = 0; xmm < 16; ++xmm) {
+        if (xmms & 1u << xmm) {
+            p = emitStackXmm(p, xmm, offset, false, ymm);
+            offset += slot;
+        }
+    }
+    p = emitAdjustStack(p, -frame);
+    for (unsigned reg = 16; reg--;) {
+        if (!(gprs & 1u << reg))
+            continue;
+        /* 1 or 2 bytes: popq %reg */
+        if (reg >= 8)
+            *p++ = 0x41;
+        *p++ = 0x58 | (reg & 7);
+    }
+    /* 1 byte: ret */
+    *p++ = 0xC3;
+    return p - buffer;
+}
+
+static void patchAssistCall(void*, uint8_t* p, uint8_t* executable, uint8_t* stub)
+{
+    /* 5 bytes: call rel32, the code cache being smaller than 2GB */
+    intptr_t delta = stub - (executable + 5);
+    assert(delta == static_cast<int32_t>(delta));
+    *p++ = 0xE8;
+    *reinterpret_cast<int32_t*>(p) = static_cast<int32_t>(delta);
+}
+
 static const char* symbolLookupCallback(void* DisInfo, uint64_t ReferenceValue,
     uint64_t* ReferenceType,
     uint64_t ReferencePC,
@@ -187,15 +507,15 @@ static const char* symbolLookupCallback(void* DisInfo, uint64_t ReferenceValue,
     return nullptr;
 }
 
-static void disassemble(jit::ByteBuffer& code)
+static void disassemble(uint8_t* code, size_t size)
 {
     LLVMDisasmContextRef DCR = LLVMCreateDisasm("x86_64-pc-linux", nullptr, 0,
         nullptr, symbolLookupCallback);
 
-    uint8_t* BytesP = code.data();
+    uint8_t* BytesP = code;
 
-    unsigned NumBytes = code.size();
-    unsigned PC = 0;
+    unsigned NumBytes = size;
+    uint64_t PC = reinterpret_cast<uintptr_t>(code);
     const char OutStringSize = 100;
     char OutString[OutStringSize];
     printf("================================================================================\n");
@@ -209,36 +529,125 @@ static void disassemble(jit::ByteBuffer& code)
         NumBytes -= InstSize;
         printf("%s\n", OutString);
     }
+    LLVMDisasmDispose(DCR);
 }
 
 static void disassemble(State& state)
 {
     for (auto& code : state.m_codeSectionList) {
-        disassemble(code);
+        disassemble(state.m_codeCache.executableAddress(code.m_data), code.m_size);
     }
 }
 
+static bool buildBlock(void*, State& state, uintptr_t pc)
+{
+    if (pc == entryPC)
+        buildIR(state);
+    else if (pc == loopPC)
+        buildLoopIR(state);
+    else if (pc == regionPC)
+        buildRegionIR(state);
+    else if (pc == zeroPC)
+        buildZeroIR(state);
+    else
+        return false;
+    jit::dumpModule(state.m_module);
+    return true;
+}
+
+static void linked(void*, State& state)
+{
+    disassemble(state);
+}
+
+struct Translator {
+    jit::CompileService& m_service;
+    const PlatformDesc& m_desc;
+};
+
+static void* translate(void* opaque, uintptr_t pc)
+{
+    using namespace jit;
+    Translator& translator = *static_cast<Translator*>(opaque);
+    CompileRequest request = { pc, buildBlock, nullptr, translator.m_desc, linked };
+    return translator.m_service.translate(request);
+}
+
 int main()
 {
     initLLVM();
     using namespace jit;
+    CompileStats::shared().dumpAtExit();
     PlatformDesc desc = {
-        40 * sizeof(intptr_t), /* context size */
+        (40 + 2 * 64 + 16 * 4 + 16 * 4) * sizeof(intptr_t), /* context size */
         192, /* offset of pc */
         3, /* prologue size */
         17, /* direct size */
         17, /* indirect size */
         17, /* assist size */
+        5, /* assist call size */
+        512, /* assist stub size */
+        40 * sizeof(intptr_t), /* offset of indirect branch cache */
+        64, /* indirect branch cache entries */
+        28 * sizeof(intptr_t), /* offset of pending flags */
+        (40 + 2 * 64) * sizeof(intptr_t), /* offset of vector registers */
+        16, /* vector registers */
+        vectorSize, /* vector register size */
+        0, /* guest memory base, unused with a soft TLB */
+        (40 + 2 * 64 + 16 * 4) * sizeof(intptr_t), /* offset of the soft TLB */
+        16, /* soft TLB entries */
+        guestPageShift,
+        { /* load misses, by size */
+            reinterpret_cast<void*>(mytlbmiss<1>), reinterpret_cast<void*>(mytlbmiss<2>), reinterpret_cast<void*>(mytlbmiss<4>),
+            reinterpret_cast<void*>(mytlbmiss<8>), reinterpret_cast<void*>(mytlbmiss<16>), reinterpret_cast<void*>(mytlbmiss<32>) },
+        { /* store misses */
+            reinterpret_cast<void*>(mytlbmiss<1>), reinterpret_cast<void*>(mytlbmiss<2>), reinterpret_cast<void*>(mytlbmiss<4>),
+            reinterpret_cast<void*>(mytlbmiss<8>), reinterpret_cast<void*>(mytlbmiss<16>), reinterpret_cast<void*>(mytlbmiss<32>) },
+        32 * sizeof(intptr_t), /* offset of the exit request */
         nullptr, /* opaque */
         patchProloge,
         patchDirect,
+        patchIndirect,
         patchAssist,
+        chainDirect,
+        patchIndirectJump,
+        emitAssistStub,
+        patchAssistCall,
     };
-    State state("test", desc);
-    buildIR(state);
-    dumpModule(state.m_module);
-    compile(state);
-    link(state);
-    disassemble(state);
+    // 16MB budget, evicted an eighth at a time.
+    CodeCache codeCache(16 << 20, 8);
+    TranslationCache translationCache;
+    // Keep optimized translations across runs when asked to.
+    std::unique_ptr<PersistentCache> persistentCache;
+    if (const char* path = getenv("JIT_CACHE"))
+        persistentCache.reset(new PersistentCache(path, desc));
+    BlockChainer chainer(translationCache, codeCache, desc);
+    CompileService service(codeCache, translationCache, &chainer, 2);
+    service.setTierUpThreshold(4);
+    service.setPersistentCache(persistentCache.get());
+    Translator translator = { service, desc };
+    Dispatcher dispatcher(translationCache, desc, myenter, translate, &translator, &chainer);
+    tlbDesc = &desc;
+    alignas(32) intptr_t context[40 + 2 * 64 + 16 * 4 + 16 * 4] = { 41, 0, 1 };
+    context[desc.m_pcFieldOffset / sizeof(intptr_t)] = entryPC;
+    intptr_t* vectors = context + desc.m_vectorOffset / sizeof(intptr_t);
+    for (unsigned i = 0; i < 8; ++i)
+        vectors[i] = 10 + i;
+    // Let the workers get ahead of the guest.
+    CompileRequest successor = { loopPC, buildBlock, nullptr, desc, linked };
+    service.prefetch(successor);
+    dispatcher.run(context);
+    if (persistentCache)
+        persistentCache->save();
+    printf("context[0] = %ld, context[1] = %ld, context[4] = %ld, context[6] = %ld, context[7] = %ld, exit pc = %lx.\n", static_cast<long>(context[0]), static_cast<long>(context[1]), static_cast<long>(context[4]), static_cast<long>(context[6]), static_cast<long>(context[7]), static_cast<unsigned long>(dispatcher.guestPC(context)));
+    printf("pc 0 %s.\n", translationCache.lookup(zeroPC) ? "translated" : "missing");
+    printf("vector[0] = %ld %ld %ld %ld.\n", static_cast<long>(vectors[0]), static_cast<long>(vectors[1]), static_cast<long>(vectors[2]), static_cast<long>(vectors[3]));
+    uint64_t sums[2];
+    memcpy(sums, guestMemory + 0x5000, sizeof(sums[0]));
+    memcpy(sums + 1, guestMemory + 0x6000, sizeof(sums[1]));
+    printf("guest[0x5000] = %lu, guest[0x6000] = %lu, %u TLB misses.\n", static_cast<unsigned long>(sums[0]), static_cast<unsigned long>(sums[1]), tlbMisses);
+    printf("%lu dispatches, %lu translations, %lu chained exits, %lu promoted.\n", static_cast<unsigned long>(dispatcher.dispatches()), static_cast<unsigned long>(dispatcher.translations()), static_cast<unsigned long>(chainer.chainedCount()), static_cast<unsigned long>(service.promoted()));
+    printf("code cache: %lu of %lu bytes used, %lu sectors evicted (%lu bytes).\n", static_cast<unsigned long>(codeCache.used()), static_cast<unsigned long>(codeCache.capacity()),
+        static_cast<unsigned long>(codeCache.evictions()), static_cast<unsigned long>(codeCache.evictedBytes()));
     return 0;
 }
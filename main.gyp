@@ -13,5 +13,15 @@
                 '<(DEPTH)/llvm/llvm.gyp:libllvm',
             ]
         },
+        {
+            'target_name': 'bench',
+            'type': 'executable',
+            'sources': [
+                'bench.cpp'
+             ],
+            'dependencies': [
+                '<(DEPTH)/llvm/llvm.gyp:libllvm',
+            ]
+        },
     ],
 }